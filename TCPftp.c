@@ -1,4 +1,4 @@
- /* TCPftp.c - main, sendCmd, pasivo */
+ /* TCPftp.c - main, do_mget_fork, ayuda (frontend de libftpclient) */
 
 #define _POSIX_C_SOURCE 200809L
 
@@ -7,36 +7,39 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
-#include <ctype.h>
 
-#include <netdb.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
 
+#include <sys/stat.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include <time.h>
 
-#include <sys/select.h>
-#include <sys/time.h>
+#include "ftpclient.h"
 
 
 extern int  errno;
 
 int  errexit(const char *format, ...);
-int  connectTCP(const char *host, const char *service);
-int  passiveTCP(const char *service, int qlen);
-
-#define LINELEN 512
-#define DATA_BUFSIZE 1024
+int  daemon_main(const char *host, const char *service,
+                 const char *user, const char *pass);
+int  job_client(int argc, char *argv[]);
+int  journal_begin(const char *path, char **files, int nfiles, long long *resume,
+                   long long *size);
+int  journal_append(int fd, char st, long long off, const char *name);
+int  journal_end(const char *path, char **files, int nfiles);
 
 /* ------------------ Globals for mget/process control ------------------ */
 volatile sig_atomic_t children_count = 0;
 int MAX_PROCS = 4; /* default, can be adjusted via FTP_PROCS env var */
-/* restart offset para REST (aplicado en la siguiente RETR) */
-long restart_offset = 0;
+int PUT_RETRIES = FTP_RETRIES_DEFAULT; /* reintentos de put/pput/mput, FTP_RETRIES */
+int IDLE_SECS = FTP_IDLE_DEFAULT; /* transferencia colgada tras n s sin datos, FTP_IDLE */
+int mget_journal = -1; /* diario del lote de mget en curso (O_APPEND) */
+int remote_cd = 0; /* hubo un cd: los hijos de mget deben seguirlo */
+
+#define JOURNAL_STEP (4 << 20)  /* registrar progreso cada 4 MB */
 
 
 /* SIGCHLD handler: reap finished children and decrement counter */
@@ -65,312 +68,395 @@ void setup_sigchld(void) {
     }
 }
 
-/* ------------------ I/O helpers ------------------ */
-ssize_t send_all(int fd, const void *buf, size_t len) {
-    size_t total = 0;
-    const char *p = buf;
-    while (total < len) {
-        ssize_t n = send(fd, p + total, len - total, 0);
-        if (n < 0) {
-            if (errno == EINTR) continue;
-            return -1;
-        }
-        total += n;
-    }
-    return (ssize_t)total;
-}
-
-ssize_t recv_line(int fd, char *buf, size_t max) {
-    size_t idx = 0;
-    char c;
-    while (idx < max - 1) {
-        ssize_t n = recv(fd, &c, 1, 0);
-        if (n <= 0) return n;
-        buf[idx++] = c;
-        if (c == '\n') break;
-    }
-    buf[idx] = '\0';
-    return (ssize_t)idx;
-}
-
-int recv_response(int s, char *res, size_t rsz) {
-    ssize_t n = recv_line(s, res, rsz);
-    if (n <= 0) return -1;
-    printf("%s", res);
-    if (strlen(res) >= 3 && isdigit((unsigned char)res[0]) &&
-        isdigit((unsigned char)res[1]) && isdigit((unsigned char)res[2])) {
-        int code = (res[0]-'0')*100 + (res[1]-'0')*10 + (res[2]-'0');
-        return code;
-    }
-    return -1;
-}
 
-/* safe send command: cmd_in no CRLF, res buffer captures response */
-int sendCmd(int s, const char *cmd_in, char *res, size_t rsz) {
-    char buf[1024];
-    snprintf(buf, sizeof(buf)-3, "%s", cmd_in);
-    strcat(buf, "\r\n");
-    if (send_all(s, buf, strlen(buf)) < 0) {
-        perror("send");
-        return -1;
+/* ------------------ mget (procesos, usando fork) ------------------ */
+/* directorio remoto actual (257 "<ruta>"); "" si el servidor no lo da */
+void remote_pwd(ftp_session *fs, char *buf, size_t n) {
+    size_t k = 0;
+    buf[0] = '\0';
+    if (ftp_cmd(fs, "PWD") != 257) return;
+    char *p = strchr(fs->reply, '"');
+    if (!p) return;
+    for (p++; *p && k + 1 < n; p++) {
+        /* "" dentro de la ruta es una comilla */
+        if (*p == '"' && *++p != '"') break;
+        buf[k++] = *p;
     }
-    return recv_response(s, res, rsz);
+    buf[k] = '\0';
 }
 
-/* ------------------ PASV ------------------ */
-int pasivo(int s) {
-    char res[LINELEN];
-    if (sendCmd(s, "PASV", res, sizeof(res)) < 0) return -1;
-    char *p = strchr(res, '(');
-    if (!p) { fprintf(stderr, "PASV: respuesta malformada: %s\n", res); return -1; }
-    int h1,h2,h3,h4,p1,p2;
-    if (sscanf(p+1, "%d,%d,%d,%d,%d,%d", &h1,&h2,&h3,&h4,&p1,&p2) != 6) {
-        fprintf(stderr, "PASV: sscanf fallo\n"); return -1;
+/* progreso del hijo en el diario: "P <offset> <clave>" cada JOURNAL_STEP */
+struct mget_prog {
+    const char *name;
+    long long   last;
+};
+
+void mget_progress(ftp_xfer *x, long long bytes, void *arg) {
+    struct mget_prog *mp = arg;
+    long long off = ftp_xfer_offset(x);
+    (void)bytes;
+    if (off >= 0 && off - mp->last >= JOURNAL_STEP) {
+        journal_append(mget_journal, 'P', off, mp->name);
+        mp->last = off;
     }
-    char host[64];
-    snprintf(host, sizeof(host), "%d.%d.%d.%d", h1,h2,h3,h4);
-    int port = p1*256 + p2;
-    char sport[32];
-    snprintf(sport, sizeof(sport), "%d", port);
-    int sdata = connectTCP(host, sport);
-    if (sdata < 0) return -1;
-    return sdata;
 }
 
-/* ------------------ pput (PORT - modo activo) robusto -------------------
- *
- * - No usa passiveTCP. Crea localmente un socket listening (bind port 0).
- * - Determina la IP local "real" usada para alcanzar al servidor usando
- *   un socket UDP conectado al peer del socket de control.
- * - Envía "PORT h1,h2,h3,h4,p1,p2", envía "STOR <file>", espera accept()
- *   con timeout, transmite el archivo y cierra todo correctamente.
+/*
+ * Cada proceso hijo hace su propia conexión de control, autentica y RETR.
+ * 'key' es el nombre del archivo en el diario; 'cwd' (si no es NULL) el
+ * directorio remoto de la sesión interactiva.
  */
-int pput(int s, const char *localfile) {
-    char res[LINELEN], cmd[256];
-    int s_listen = -1, sdata = -1;
-    FILE *fp = NULL;
-    struct sockaddr_in addr;
-    socklen_t alen = sizeof(addr);
-
-    /* 1) crear socket de escucha local y bindear a port 0 (ephemeral) */
-    s_listen = socket(AF_INET, SOCK_STREAM, 0);
-    if (s_listen < 0) { perror("socket"); return -1; }
-
-    /* permitir quick reuse */
-    {
-        int opt = 1;
-        setsockopt(s_listen, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+int do_mget_fork(const char *host, const char *service, const char *user, const char *pass, char *filename, const ftp_session *opts, long long resume,
+                 const char *key, const char *cwd) {
+    pid_t pid;
+    /* Si estamos al limite, esperar (liberado por SIGCHLD handler) */
+    while (children_count >= MAX_PROCS) {
+        /* dormir corto y reintentar */
+        struct timespec ts = {0, 200000000}; /* 200ms */
+        nanosleep(&ts, NULL);
     }
 
-    struct sockaddr_in sin;
-    memset(&sin, 0, sizeof(sin));
-    sin.sin_family = AF_INET;
-    sin.sin_addr.s_addr = INADDR_ANY;
-    sin.sin_port = htons(0); /* 0 => kernel elige puerto */
-
-    if (bind(s_listen, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
-        perror("bind");
-        close(s_listen);
-        return -1;
-    }
-    if (listen(s_listen, 1) < 0) {
-        perror("listen");
-        close(s_listen);
+    fflush(stdout); /* que el hijo no repita lo que el padre tiene en buffer */
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
         return -1;
     }
+    if (pid == 0) {
+        /* CHILD */
+        printf("[child %d] Empezando a descargar %s\n", getpid(), filename);
 
-    /* 2) averiguar puerto asignado */
-    if (getsockname(s_listen, (struct sockaddr*)&addr, &alen) < 0) {
-        perror("getsockname");
-        close(s_listen);
-        return -1;
-    }
-    unsigned short port = ntohs(addr.sin_port);
-
-    /* 3) determinar la IP local "correcta" usando un socket UDP conectado al peer */
-    struct sockaddr_storage peer;
-    socklen_t plen = sizeof(peer);
-    if (getpeername(s, (struct sockaddr*)&peer, &plen) < 0) {
-        perror("getpeername");
-        close(s_listen);
-        return -1;
+        ftp_session fs;
+        ftp_init(&fs);
+        fs.log = stdout;
+        if (ftp_open(&fs, host, service) < 0 || ftp_login(&fs, user, pass) < 0) {
+            fprintf(stderr, "[child] %s\n", fs.errmsg);
+            exit(1);
+        }
+        /* mismo directorio y modos que la sesión interactiva */
+        if (cwd && cwd[0] && ftp_cmd(&fs, "CWD %s", cwd) != 250) {
+            fprintf(stderr, "[child] CWD %s: %s\n", cwd, fs.reply);
+            exit(1);
+        }
+        ftp_active(&fs, opts->active);
+        ftp_idle(&fs, IDLE_SECS);
+        fs.wmode = opts->wmode;
+        if (opts->ascii && ftp_type(&fs, 1) < 0) {
+            fprintf(stderr, "[child] %s\n", fs.errmsg);
+            exit(1);
+        }
+        /*
+         * retomar desde lo que el diario da por escrito: TYPE I aquí y el
+         * REST lo envía la propia transferencia (si lo rechaza, desde 0)
+         */
+        if (resume > 0 && !opts->ascii && ftp_type(&fs, 0) == 0) {
+            fs.restart_offset = resume;
+            printf("[child %d] %s: reanudando desde %lld\n", getpid(), filename, resume);
+        }
+        struct mget_prog mp = { key, fs.restart_offset };
+        ftp_xfer *x = ftp_xfer_get(&fs, filename, filename);
+        int rc = -1;
+        if (x) {
+            ftp_xfer_callbacks(x, mget_progress, NULL, &mp);
+            rc = ftp_xfer_wait(x) == FTP_XFER_DONE ? 0 : -1;
+            ftp_xfer_free(x);
+        }
+        struct stat st;
+        if (rc == 0)
+            journal_append(mget_journal, 'D', stat(filename, &st) == 0 ? (long long)st.st_size : -1, key);
+        else
+            fprintf(stderr, "[child] %s: %s\n", filename, fs.errmsg);
+        ftp_close(&fs);
+        exit(rc < 0 ? 1 : 0);
+    } else {
+        /* PARENT: incrementa contador y retorna */
+        children_count++;
+        return 0;
     }
+}
 
-    int udp = socket(((struct sockaddr*)&peer)->sa_family, SOCK_DGRAM, 0);
-    if (udp < 0) {
-        perror("socket udp");
-        close(s_listen);
+/* ------------------ mput (pool de procesos, cada uno con su sesión) ------------------ */
+/*
+ * El padre reparte índices de archivo por un pipe (escrituras de un int son
+ * atómicas) y los workers devuelven un registro de resultado por archivo por
+ * otro pipe. Cada worker hace login una sola vez y sube archivos hasta
+ * vaciar la cola, así que el coste de conexión no escala con el número de
+ * archivos.
+ */
+struct mput_result {
+    int       idx;
+    int       ok;
+    long long bytes;
+    char      msg[200];
+};
+
+/*
+ * login y, si la sesión interactiva hizo cd, el mismo directorio: con el
+ * CWD rechazado la sesión se cierra y el archivo falla en vez de subirse a
+ * otro sitio
+ */
+int mput_login(ftp_session *fs, const char *host, const char *service,
+               const char *user, const char *pass, const char *cwd) {
+    if (ftp_open(fs, host, service) < 0 || ftp_login(fs, user, pass) < 0) return -1;
+    if (cwd && cwd[0]) {
+        int code = ftp_cmd(fs, "CWD %s", cwd);
+        if (code == 250) return 0;
+        char msg[sizeof(fs->errmsg)];
+        if (code > 0) snprintf(msg, sizeof(msg), "CWD %.100s: %.140s", cwd, fs->reply);
+        else snprintf(msg, sizeof(msg), "%s", fs->errmsg);
+        ftp_close(fs);
+        snprintf(fs->errmsg, sizeof(fs->errmsg), "%s", msg);
         return -1;
     }
-    /* conectar UDP al peer (no envía nada) para que el kernel seleccione interfaz */
-    if (connect(udp, (struct sockaddr*)&peer, plen) < 0) {
-        /* si falla, aún podemos probar con getsockname(control) como fallback */
-        /* perror("connect udp (fallback)"); */
-    }
+    return 0;
+}
 
-    struct sockaddr_storage localss;
-    socklen_t localss_len = sizeof(localss);
-    if (getsockname(udp, (struct sockaddr*)&localss, &localss_len) < 0) {
-        /* fallback: intenta getsockname() del socket de control */
-        struct sockaddr_in localaddr;
-        socklen_t localalen = sizeof(localaddr);
-        if (getsockname(s, (struct sockaddr*)&localaddr, &localalen) < 0) {
-            perror("getsockname(control) fallback");
-            close(udp);
-            close(s_listen);
-            return -1;
+void mput_worker(int tasks, int results, const char *host, const char *service,
+                 const char *user, const char *pass, char **files, int active,
+                 const char *cwd) {
+    ftp_session fs;
+    struct mput_result r;
+    int idx;
+
+    ftp_init(&fs);
+    /* si falla, la sesión queda cerrada y cada archivo lo reintenta abajo */
+    if (mput_login(&fs, host, service, user, pass, cwd) < 0)
+        fprintf(stderr, "[mput %d] %s\n", getpid(), fs.errmsg);
+    /* modo activo: listeners preparados mientras se sube el archivo anterior */
+    ftp_active(&fs, active);
+    ftp_retries(&fs, PUT_RETRIES);
+    ftp_idle(&fs, IDLE_SECS);
+    while (read(tasks, &idx, sizeof(idx)) == sizeof(idx)) {
+        memset(&r, 0, sizeof(r));
+        r.idx = idx;
+        /* una sesión caída se reabre antes del siguiente archivo */
+        if (!ftp_alive(&fs)) {
+            ftp_close(&fs);
+            if (mput_login(&fs, host, service, user, pass, cwd) < 0) {
+                snprintf(r.msg, sizeof(r.msg), "%.199s", fs.errmsg);
+                write(results, &r, sizeof(r));
+                continue;
+            }
+        }
+        int rc = ftp_put(&fs, files[idx], files[idx]);
+        if (rc == 0) {
+            struct stat st;
+            r.ok = 1;
+            r.bytes = stat(files[idx], &st) == 0 ? (long long)st.st_size : 0;
         } else {
-            memcpy(&localss, &localaddr, sizeof(localaddr));
-            localss_len = sizeof(localaddr);
+            snprintf(r.msg, sizeof(r.msg), "%.199s", fs.errmsg);
         }
+        write(results, &r, sizeof(r));
     }
-    close(udp);
+    ftp_close(&fs);
+    exit(0);
+}
 
-    char local_ip_str[INET6_ADDRSTRLEN] = {0};
-    if (localss.ss_family == AF_INET) {
-        struct sockaddr_in *sinp = (struct sockaddr_in*)&localss;
-        inet_ntop(AF_INET, &sinp->sin_addr, local_ip_str, sizeof(local_ip_str));
-    } else {
-        /* no soportamos IPv6 para PORT (IPv4) en esta versión */
-        fprintf(stderr, "pput: IPv6 no soportado en PORT\n");
-        close(s_listen);
-        return -1;
+int do_mput(const char *host, const char *service, const char *user, const char *pass,
+            char **files, int nfiles, int active, const char *cwd) {
+    int tp[2], rp[2];
+    int nworkers = nfiles < MAX_PROCS ? nfiles : MAX_PROCS;
+    int sent = 0, failed = 0;
+    char *reported;
+
+    if (nfiles == 0) return 0;
+    if (!(reported = calloc(nfiles, 1))) { perror("calloc"); return -1; }
+    if (pipe(tp) < 0 || pipe(rp) < 0) { perror("pipe"); free(reported); return -1; }
+
+    fflush(stdout);
+    for (int i = 0; i < nworkers; i++) {
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork"); continue; }
+        if (pid == 0) {
+            close(tp[1]);
+            close(rp[0]);
+            mput_worker(tp[0], rp[1], host, service, user, pass, files, active, cwd);
+        }
+        children_count++;
     }
+    close(tp[0]);
+    close(rp[1]);
+    fcntl(tp[1], F_SETFL, fcntl(tp[1], F_GETFL) | O_NONBLOCK);
 
-    /* 4) construir PORT h1,h2,h3,h4,p1,p2 */
-    char ip_commas[64];
-    snprintf(ip_commas, sizeof(ip_commas), "%s", local_ip_str);
-    for (size_t i = 0; i < strlen(ip_commas); ++i) if (ip_commas[i]=='.') ip_commas[i]=',';
-
-    int p1 = port / 256;
-    int p2 = port % 256;
-    snprintf(cmd, sizeof(cmd), "PORT %s,%d,%d", ip_commas, p1, p2);
-
-    /* 5) enviar PORT y comprobar respuesta */
-    int code = sendCmd(s, cmd, res, sizeof(res));
-    if (code < 0) {
-        fprintf(stderr, "Error enviando PORT\n");
-        close(s_listen);
-        return -1;
+    /* repartir índices y recoger resultados a la vez (ningún pipe se llena) */
+    while (1) {
+        struct pollfd pfd[2];
+        int nfd = 0;
+        pfd[nfd].fd = rp[0];
+        pfd[nfd++].events = POLLIN;
+        if (tp[1] >= 0) {
+            pfd[nfd].fd = tp[1];
+            pfd[nfd++].events = POLLOUT;
+        }
+        if (poll(pfd, nfd, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (nfd > 1 && pfd[1].revents) {
+            while (sent < nfiles && write(tp[1], &sent, sizeof(sent)) == sizeof(sent))
+                sent++;
+            /* todos entregados, o no queda ningún worker leyendo */
+            if (sent == nfiles || errno == EPIPE || (pfd[1].revents & POLLERR)) {
+                close(tp[1]);
+                tp[1] = -1;
+            }
+        }
+        if (pfd[0].revents) {
+            struct mput_result r;
+            ssize_t n = read(rp[0], &r, sizeof(r));
+            if (n == 0) break;
+            if (n != sizeof(r) || r.idx < 0 || r.idx >= nfiles) continue;
+            reported[r.idx] = 1;
+            if (r.ok) {
+                printf("OK    %s (%lld bytes)\n", files[r.idx], r.bytes);
+            } else {
+                failed++;
+                printf("FALLO %s: %s\n", files[r.idx], r.msg);
+            }
+            fflush(stdout);
+        }
     }
-    /* server puede devolver 200 o error (4xx/5xx) */
-    if (code >= 400) {
-        fprintf(stderr, "Server PORT error: %s\n", res);
-        close(s_listen);
-        return -1;
+    if (tp[1] >= 0) close(tp[1]);
+    close(rp[0]);
+
+    /* archivos que ningún worker llegó a procesar */
+    for (int i = 0; i < nfiles; i++) {
+        if (!reported[i]) {
+            failed++;
+            printf("FALLO %s: sin worker disponible\n", files[i]);
+        }
     }
+    free(reported);
 
-    /* 6) enviar STOR */
-    char storcmd[256];
-    snprintf(storcmd, sizeof(storcmd), "STOR %s", localfile);
-    code = sendCmd(s, storcmd, res, sizeof(res));
-    if (code < 0) { fprintf(stderr, "Error enviando STOR\n"); close(s_listen); return -1; }
-    if (code >= 400) { fprintf(stderr, "Server STOR error: %s\n", res); close(s_listen); return -1; }
-
-    /* 7) esperar accept con timeout */
-    fd_set rfds;
-    struct timeval tv;
-    FD_ZERO(&rfds);
-    FD_SET(s_listen, &rfds);
-    tv.tv_sec = 8;
-    tv.tv_usec = 0;
-    int sel = select(s_listen + 1, &rfds, NULL, NULL, &tv);
-    if (sel <= 0) {
-        if (sel == 0) fprintf(stderr, "pput: timeout esperando conexión de datos (server no conectó)\n");
-        else perror("select");
-        close(s_listen);
-        return -1;
+    while (children_count > 0) {
+        struct timespec ts = {0, 50000000}; /* 50ms */
+        nanosleep(&ts, NULL);
     }
+    printf("mput: %d OK, %d fallidos\n", nfiles - failed, failed);
+    return failed ? -1 : 0;
+}
 
-    alen = sizeof(addr);
-    sdata = accept(s_listen, (struct sockaddr *)&addr, &alen);
-    if (sdata < 0) { perror("accept"); close(s_listen); return -1; }
-
-    /* 8) enviar archivo */
-    fp = fopen(localfile, "rb");
-    if (!fp) { perror("fopen"); close(sdata); close(s_listen); return -1; }
-
-    char buf[DATA_BUFSIZE];
-    size_t nread;
-    while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0) {
-        if (send_all(sdata, buf, nread) < 0) {
-            perror("send_all");
-            fclose(fp);
-            close(sdata);
-            close(s_listen);
-            return -1;
-        }
+/* ------------------ credenciales ------------------ */
+/* FTP_USER / FTP_PASS si existen (daemon, scripts); si no, preguntar */
+int ask_credentials(char *user, size_t ulen, char *pass, size_t plen) {
+    char *eu = getenv("FTP_USER"), *ep = getenv("FTP_PASS");
+    if (eu && ep) {
+        snprintf(user, ulen, "%s", eu);
+        snprintf(pass, plen, "%s", ep);
+        return 1;
     }
-    fclose(fp);
-
-    /* 9) cerrar sdata y s_listen */
-    close(sdata);
-    close(s_listen);
-
-    /* 10) leer la respuesta final del control */
-    if (recv_response(s, res, sizeof(res)) < 0) return -1;
-    return 0;
+    printf("USER: ");
+    fflush(stdout);
+    if (!fgets(user, ulen, stdin)) return 0;
+    user[strcspn(user, "\n")] = 0;
+    printf("PASS: ");
+    fflush(stdout);
+    if (!fgets(pass, plen, stdin)) return 0;
+    pass[strcspn(pass, "\n")] = 0;
+    return 1;
 }
 
+/* ------------------ get a stdout / |cmd ------------------ */
+/* los datos van al descriptor; las respuestas del control, a stderr */
+int get_stream(ftp_session *fs, const char *remote, int outfd) {
+    FILE *log = fs->log;
+    fs->log = stderr;
+    fflush(stdout);
+    int rc = ftp_get_fd(fs, remote, outfd);
+    fs->log = log;
+    return rc;
+}
 
-/* ------------------ mget (procesos, usando fork) ------------------ */
-/* Cada proceso hijo hace su propia conexión de control, autentica y RETR */
-int do_mget_fork(const char *host, const char *service, const char *user, const char *pass, char *filename) {
-    pid_t pid;
-    /* Si estamos al limite, esperar (liberado por SIGCHLD handler) */
-    while (children_count >= MAX_PROCS) {
-        /* dormir corto y reintentar */
-        struct timespec ts = {0, 200000000}; /* 200ms */
-        nanosleep(&ts, NULL);
-    }
-
-    pid = fork();
+/*
+ * get <remoto> |cmd: la descarga es la entrada estándar de "sh -c cmd" y su
+ * salida va a 'outfd', el stdout de datos (no al stdout interactivo, que
+ * con la salida redirigida apunta a stderr)
+ */
+int get_pipe(ftp_session *fs, const char *remote, const char *cmd, int outfd) {
+    int p[2], status;
+    sigset_t set, old;
+
+    if (pipe(p) < 0) { perror("pipe"); return -1; }
+    /* el handler de SIGCHLD no debe quitarnos el estado de este hijo */
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, &old);
+    fflush(stdout);
+    pid_t pid = fork();
     if (pid < 0) {
         perror("fork");
+        close(p[0]);
+        close(p[1]);
+        sigprocmask(SIG_SETMASK, &old, NULL);
         return -1;
     }
     if (pid == 0) {
-        /* CHILD */
-        printf("[child %d] Empezando a descargar %s\n", getpid(), filename);
-        sleep(10); // <---- SOLO PARA VERIFICAR
-
-        int ctrl = connectTCP(host, service);
-        if (ctrl < 0) {
-            fprintf(stderr, "[child] connectTCP fallo\n");
-            exit(1);
-        }
-        char res[LINELEN];
-
-        if (recv_response(ctrl, res, sizeof(res)) < 0) { close(ctrl); exit(1); }
-
-        char cmd[256];
-        snprintf(cmd, sizeof(cmd), "USER %s", user);
-        sendCmd(ctrl, cmd, res, sizeof(res));
-        snprintf(cmd, sizeof(cmd), "PASS %s", pass);
-        sendCmd(ctrl, cmd, res, sizeof(res));
-
-        int sdata = pasivo(ctrl);
-        if (sdata < 0) { close(ctrl); exit(1); }
-
-        snprintf(cmd, sizeof(cmd), "RETR %s", filename);
-        sendCmd(ctrl, cmd, res, sizeof(res));
-        FILE *fp = fopen(filename, "wb");
-        if (!fp) { perror("fopen child"); close(sdata); close(ctrl); exit(1); }
-        ssize_t n;
-        char databuf[DATA_BUFSIZE];
-        while ((n = recv(sdata, databuf, sizeof(databuf), 0)) > 0) {
-            fwrite(databuf, 1, n, fp);
+        sigprocmask(SIG_SETMASK, &old, NULL);
+        signal(SIGPIPE, SIG_DFL);   /* SIG_IGN se heredaría a través de exec */
+        dup2(p[0], STDIN_FILENO);
+        close(p[0]);
+        close(p[1]);
+        if (outfd != STDOUT_FILENO) {
+            dup2(outfd, STDOUT_FILENO);
+            close(outfd);
         }
-        fclose(fp);
-        close(sdata);
-        recv_response(ctrl, res, sizeof(res));
-        close(ctrl);
-        exit(0);
-    } else {
-        /* PARENT: incrementa contador y retorna */
-        children_count++;
+        execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+        _exit(127);
+    }
+    close(p[0]);
+    int rc = get_stream(fs, remote, p[1]);
+    close(p[1]);    /* EOF para el comando */
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    if (rc == 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+        snprintf(fs->errmsg, sizeof(fs->errmsg), "'%.200s' terminó con error", cmd);
+        return -1;
+    }
+    return rc;
+}
+
+/* ------------------ fxp ------------------ */
+/*
+ * Sesión con el segundo servidor, reutilizada entre comandos fxp mientras
+ * el host y el puerto no cambien. Credenciales: FTP_FXP_USER/FTP_FXP_PASS
+ * o se preguntan.
+ */
+static ftp_session fxp_fs = { .ctrl = -1 };
+static char fxp_host[256], fxp_port[16];
+
+int fxp_open(const char *host, const char *service) {
+    if (fxp_fs.ctrl >= 0 && strcmp(fxp_host, host) == 0 &&
+        strcmp(fxp_port, service) == 0 && ftp_alive(&fxp_fs))
         return 0;
+    if (fxp_fs.ctrl >= 0) ftp_close(&fxp_fs);
+    ftp_init(&fxp_fs);
+    fxp_fs.log = stdout;
+    if (ftp_open(&fxp_fs, host, service) < 0) return -1;
+
+    char user[128], pass[128];
+    char *eu = getenv("FTP_FXP_USER"), *ep = getenv("FTP_FXP_PASS");
+    if (eu && ep) {
+        snprintf(user, sizeof(user), "%s", eu);
+        snprintf(pass, sizeof(pass), "%s", ep);
+    } else {
+        printf("USER (%s): ", host);
+        fflush(stdout);
+        if (!fgets(user, sizeof(user), stdin)) user[0] = 0;
+        user[strcspn(user, "\n")] = 0;
+        printf("PASS (%s): ", host);
+        fflush(stdout);
+        if (!fgets(pass, sizeof(pass), stdin)) pass[0] = 0;
+        pass[strcspn(pass, "\n")] = 0;
+    }
+    if (ftp_login(&fxp_fs, user, pass) < 0) {
+        ftp_close(&fxp_fs);
+        return -1;
     }
+    snprintf(fxp_host, sizeof(fxp_host), "%s", host);
+    snprintf(fxp_port, sizeof(fxp_port), "%s", service);
+    return 0;
 }
 
 /* ------------------ ayuda ------------------ */
@@ -379,14 +465,21 @@ void ayuda() {
     printf("Comandos disponibles:\n");
     printf("  dir                 - listar directorio remoto (LIST)\n");
     printf("  get <remoto>        - descargar archivo (RETR). Use REST antes para reanudar\n");
-    printf("  put <local>         - subir archivo (PASV)\n");
-    printf("  pput <local>        - subir archivo (PORT / activo)\n");
+    printf("  get <remoto> -      - descargar a la salida estándar (respuestas por stderr)\n");
+    printf("  get <remoto> |cmd   - descargar a la entrada de un comando (ej: |gunzip -c > x)\n");
+    printf("  put [-c] <local>    - subir archivo (PASV; -c = continuar desde el tamaño remoto)\n");
+    printf("  pput [-c] <local>   - subir archivo (PORT / activo)\n");
     printf("  mget <f1> <f2> ...  - descargar archivos en paralelo (forks)\n");
+    printf("  mput [-a] <p1> ...  - subir archivos/patrones en paralelo (-a = PORT / activo)\n");
+    printf("  fxp <host> <puerto> <remoto> [destino] - copiar del servidor actual a otro (FXP)\n");
     printf("  mkd <dir>           - crea directorio remoto (MKD)\n");
     printf("  pwd                 - muestra directorio remoto (PWD)\n");
     printf("  dele <file>         - borra archivo remoto (DELE)\n");
     printf("  rest <offset>       - prepara REST para la siguiente descarga (RETR)\n");
     printf("  cd <dir>            - CWD (cambiar directorio remoto)\n");
+    printf("  active / passive    - conexiones de datos por PORT / PASV (get, dir, mget, mput)\n");
+    printf("  ascii / binary      - TYPE A (convierte CRLF <-> LF en get, put, mget) / TYPE I\n");
+    printf("  writer <modo>       - escritura de get/mget: cache, stream (sin llenar la page cache), direct (O_DIRECT)\n");
     printf("  quit                - salir\n");
     printf("  help                - despliega este texto de ayuda\n\n");
 }
@@ -396,6 +489,18 @@ void ayuda() {
 int main(int argc, char *argv[]) {
     char *host = "localhost";
     char *service = "21";
+
+    /* TCPftp -J <trabajo>: enviar un trabajo al daemon y salir */
+    if (argc >= 2 && strcmp(argv[1], "-J") == 0)
+        return job_client(argc - 2, argv + 2);
+
+    /* TCPftp -D [host [puerto]]: daemon con sesiones calientes */
+    int daemon_mode = 0;
+    if (argc >= 2 && strcmp(argv[1], "-D") == 0) {
+        daemon_mode = 1;
+        argv++;
+        argc--;
+    }
     if (argc >= 2) host = argv[1];
     if (argc >= 3) service = argv[2];
 
@@ -405,6 +510,10 @@ int main(int argc, char *argv[]) {
         int v = atoi(env);
         if (v > 0) MAX_PROCS = v;
     }
+    env = getenv("FTP_RETRIES");
+    if (env) PUT_RETRIES = atoi(env);
+    env = getenv("FTP_IDLE");
+    if (env) IDLE_SECS = atoi(env);
 
     /* instalar SIGCHLD handler */
     setup_sigchld();
@@ -415,31 +524,46 @@ int main(int argc, char *argv[]) {
     sa2.sa_handler = SIG_IGN;
     sigaction(SIGPIPE, &sa2, NULL);
 
+    char user[128], pass[128];
+    if (daemon_mode) {
+        if (!ask_credentials(user, sizeof(user), pass, sizeof(pass))) exit(0);
+        return daemon_main(host, service, user, pass);
+    }
+
+    /*
+     * stdout redirigido (TCPftp ... | gunzip, TCPftp ... > datos.bin): por
+     * stdout sólo salen datos (get -, dir) y el resto de la salida
+     * interactiva pasa a stderr.
+     */
+    int data_out = STDOUT_FILENO;
+    if (!isatty(STDOUT_FILENO) && (data_out = dup(STDOUT_FILENO)) >= 0)
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    else
+        data_out = STDOUT_FILENO;
+
     /* Conectar control principal */
-    int s = connectTCP(host, service);
-    char res[LINELEN];
-    if (recv_response(s, res, sizeof(res)) < 0) errexit("No banner\n");
+    ftp_session fs;
+    ftp_init(&fs);
+    fs.log = stdout;
+    if (ftp_open(&fs, host, service) < 0) errexit("%s\n", fs.errmsg);
 
     /* pedir user/pass una vez (los hijos los usarán) */
-    char user[128], pass[128];
-    printf("USER: ");
-    if (!fgets(user, sizeof(user), stdin)) exit(0);
-    user[strcspn(user, "\n")] = 0;
-    printf("PASS: ");
-    if (!fgets(pass, sizeof(pass), stdin)) exit(0);
-    pass[strcspn(pass, "\n")] = 0;
+    if (!ask_credentials(user, sizeof(user), pass, sizeof(pass))) exit(0);
 
     /* login en conexión principal (opcional) */
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "USER %s", user);
-    sendCmd(s, cmd, res, sizeof(res));
-    snprintf(cmd, sizeof(cmd), "PASS %s", pass);
-    sendCmd(s, cmd, res, sizeof(res));
+    if (ftp_login(&fs, user, pass) < 0) fprintf(stderr, "%s\n", fs.errmsg);
+
+    /* FTP_WRITER=stream|direct: descargas grandes sin llenar la page cache */
+    char *wr = getenv("FTP_WRITER");
+    if (wr && ftp_writer(&fs, wr) < 0) fprintf(stderr, "FTP_WRITER: %s\n", fs.errmsg);
+    ftp_retries(&fs, PUT_RETRIES);
+    ftp_idle(&fs, IDLE_SECS);
 
     ayuda();
     char line[512];
     while (1) {
         printf("ftp> ");
+        fflush(stdout);
         if (!fgets(line, sizeof(line), stdin)) break;
         line[strcspn(line, "\n")] = 0;
         char *tok = strtok(line, " ");
@@ -448,128 +572,109 @@ int main(int argc, char *argv[]) {
         if (strcmp(tok, "help") == 0) { ayuda(); continue; }
 
         if (strcmp(tok, "dir") == 0) {
-            int sdata = pasivo(s);
-            if (sdata < 0) { fprintf(stderr, "pasivo fallo\n"); continue; }
-            sendCmd(s, "LIST", res, sizeof(res));
-            ssize_t n;
-            char buf[DATA_BUFSIZE];
-            while ((n = recv(sdata, buf, sizeof(buf), 0)) > 0) fwrite(buf,1,n,stdout);
-            close(sdata);
-            recv_response(s, res, sizeof(res));
+            fflush(stdout);
+            if (ftp_list(&fs, data_out) < 0) fprintf(stderr, "dir: %s\n", fs.errmsg);
             continue;
         }
 
         if (strcmp(tok, "get") == 0) {
             char *arg = strtok(NULL, " ");
-            if (!arg) { printf("Uso: get <remote>\n"); continue; }
-
-            /* Si se definió restart_offset, volvemos a poner TYPE I y REST (por seguridad) */
-            if (restart_offset > 0) {
-                char restres[LINELEN];
-                if (sendCmd(s, "TYPE I", restres, sizeof(restres)) < 0) {
-                    fprintf(stderr, "Error estableciendo TYPE I\n");
-                    /* no abortamos: intentamos continuar */
-                }
-                char cmdrest[256];
-                snprintf(cmdrest, sizeof(cmdrest), "REST %ld", restart_offset);
-                int code = sendCmd(s, cmdrest, restres, sizeof(restres));
-                if (code >= 300 && code < 400) {
-                    printf("REST %ld aceptado por servidor; reanudando.\n", restart_offset);
-                } else {
-                    printf("REST no aceptado por servidor: %s\n", restres);
-                    /* limpiar para no intentar de nuevo */
-                    restart_offset = 0;
-                }
-            }
-
-            int sdata = pasivo(s);
-            if (sdata < 0) { fprintf(stderr, "pasivo fallo\n"); continue; }
-
-            snprintf(cmd, sizeof(cmd), "RETR %s", arg);
-            sendCmd(s, cmd, res, sizeof(res));
-
-            /* Abrir/crear el fichero local de forma que podamos reanudar (r+b o w+b) */
-            FILE *fp = fopen(arg, "r+b");
-            if (!fp) {
-                /* no existe -> crear */
-                fp = fopen(arg, "w+b");
-                if (!fp) {
-                    perror("fopen");
-                    close(sdata);
-                    /* limpiar restart_offset (no aplicado) */
-                    restart_offset = 0;
-                    continue;
-                }
-            }
-
-            /* Si hay restart_offset, posicionar el puntero local */
-            if (restart_offset > 0) {
-                if (fseek(fp, restart_offset, SEEK_SET) != 0) {
-                    perror("fseek");
-                    /* seguimos de todas formas; la escritura empezará donde el SO permita */
-                }
-            } else {
-                /* si no reanudamos, truncamos el archivo (por si existía) */
-                if (ftruncate(fileno(fp), 0) != 0) {
-                    /* no crítico; sólo aviso */
-                    /* perror("ftruncate"); */
-                }
-            }
-
-            ssize_t n;
-            char buf[DATA_BUFSIZE];
-            while ((n = recv(sdata, buf, sizeof(buf), 0)) > 0) {
-                size_t wrote = fwrite(buf,1,n,fp);
-                if (wrote != (size_t)n) {
-                    perror("fwrite");
-                    break;
-                }
-            }
-            fclose(fp);
-            close(sdata);
-            recv_response(s, res, sizeof(res));
-
-            /* limpiar restart_offset ya aplicado */
-            restart_offset = 0;
+            char *dest = strtok(NULL, "");
+            if (!arg) { printf("Uso: get <remote> [local | - | |cmd]\n"); continue; }
+            while (dest && *dest == ' ') dest++;
+            int rc;
+            if (!dest || !*dest) rc = ftp_get(&fs, arg, arg);
+            else if (strcmp(dest, "-") == 0) rc = get_stream(&fs, arg, data_out);
+            else if (dest[0] == '|') rc = get_pipe(&fs, arg, dest + 1, data_out);
+            else rc = ftp_get(&fs, arg, dest);
+            if (rc < 0) fprintf(stderr, "get: %s\n", fs.errmsg);
             continue;
         }
 
-
-
+        /* -c: continuar una subida cortada desde el tamaño remoto */
         if (strcmp(tok, "put") == 0) {
             char *arg = strtok(NULL, " ");
-            if (!arg) { printf("Uso: put <file>\n"); continue; }
-            int sdata = pasivo(s);
-            if (sdata < 0) { fprintf(stderr, "pasivo fallo\n"); continue; }
-            snprintf(cmd, sizeof(cmd), "STOR %s", arg);
-            sendCmd(s, cmd, res, sizeof(res));
-            FILE *fp = fopen(arg, "rb");
-            if (!fp) { perror("fopen"); close(sdata); continue; }
-            size_t r; char buf[DATA_BUFSIZE];
-            while ((r = fread(buf,1,sizeof(buf),fp)) > 0) {
-                if (send_all(sdata, buf, r) < 0) { perror("send data"); break; }
-            }
-            fclose(fp);
-            close(sdata);
-            recv_response(s, res, sizeof(res));
+            int cont = arg && strcmp(arg, "-c") == 0;
+            if (cont) arg = strtok(NULL, " ");
+            if (!arg) { printf("Uso: put [-c] <file>\n"); continue; }
+            int rc = cont ? ftp_put_resume(&fs, arg, arg) : ftp_put(&fs, arg, arg);
+            if (rc < 0) fprintf(stderr, "put: %s\n", fs.errmsg);
             continue;
         }
 
         if (strcmp(tok, "pput") == 0) {
             char *arg = strtok(NULL, " ");
-            if (!arg) { printf("Uso: pput <file>\n"); continue; }
-            if (pput(s, arg) == 0) printf("pput OK\n"); else printf("pput fallo\n");
+            int cont = arg && strcmp(arg, "-c") == 0;
+            if (cont) arg = strtok(NULL, " ");
+            if (!arg) { printf("Uso: pput [-c] <file>\n"); continue; }
+            int rc = cont ? ftp_pput_resume(&fs, arg, arg) : ftp_pput(&fs, arg, arg);
+            if (rc == 0) printf("pput OK\n");
+            else printf("pput fallo: %s\n", fs.errmsg);
             continue;
         }
 
         if (strcmp(tok, "mget") == 0) {
+            char *files[256], *keys[256];
+            long long resume[256], dsize[256];
+            int nfiles = 0;
             char *file;
+            while ((file = strtok(NULL, " ")) != NULL && nfiles < 256) files[nfiles++] = file;
+            if (nfiles == 0) { printf("Uso: mget <f1> <f2> ...\n"); continue; }
+
+            /*
+             * clave en el diario: host:puerto y ruta remota, para que un
+             * mismo nombre en otro servidor u otro directorio no se salte
+             */
+            char cwd[1024];
+            remote_pwd(&fs, cwd, sizeof(cwd));
+            int nkeys = 0;
+            for (; nkeys < nfiles; nkeys++) {
+                size_t klen = strlen(host) + strlen(service) + strlen(cwd) + strlen(files[nkeys]) + 3;
+                if (!(keys[nkeys] = malloc(klen))) break;
+                if (files[nkeys][0] == '/')
+                    snprintf(keys[nkeys], klen, "%s:%s%s", host, service, files[nkeys]);
+                else
+                    snprintf(keys[nkeys], klen, "%s:%s%s%s%s", host, service, cwd,
+                             cwd[0] && cwd[strlen(cwd) - 1] == '/' ? "" : "/", files[nkeys]);
+            }
+            if (nkeys < nfiles) {
+                fprintf(stderr, "mget: sin memoria\n");
+                while (nkeys > 0) free(keys[--nkeys]);
+                continue;
+            }
+
+            /* diario del lote: lo completo se salta, lo empezado sigue con REST */
+            char *jpath = getenv("FTP_JOURNAL");
+            if (!jpath) jpath = ".TCPftp-mget.journal";
+            if (journal_begin(jpath, keys, nfiles, resume, dsize) == 0)
+                mget_journal = open(jpath, O_WRONLY | O_APPEND | O_CREAT, 0644);
+            else
+                memset(resume, 0, sizeof(resume));
+            if (mget_journal < 0)
+                fprintf(stderr, "%s: %s (mget sin diario)\n", jpath, strerror(errno));
+
             /* spawn child process for each file */
-            while ((file = strtok(NULL, " ")) != NULL) {
-                if (do_mget_fork(host, service, user, pass, file) < 0) {
-                    fprintf(stderr, "No se pudo lanzar proceso para %s\n", file);
+            for (int i = 0; i < nfiles; i++) {
+                struct stat st;
+                if (resume[i] < 0) {
+                    /* completo según el diario, si el archivo sigue ahí entero */
+                    if (stat(files[i], &st) == 0 && (dsize[i] < 0 || st.st_size == dsize[i])) {
+                        printf("%s: ya descargado (diario)\n", files[i]);
+                        continue;
+                    }
+                    printf("%s: falta o cambió desde la descarga, se repite\n", files[i]);
+                    journal_append(mget_journal, 'Q', 0, keys[i]);
+                    resume[i] = 0;
+                }
+                /* nunca más allá de lo que hay en disco (archivo borrado o recortado) */
+                if (resume[i] > 0 && (stat(files[i], &st) < 0 || st.st_size < resume[i]))
+                    resume[i] = stat(files[i], &st) < 0 ? 0 : st.st_size;
+                if (do_mget_fork(host, service, user, pass, files[i], &fs, resume[i],
+                                 keys[i], remote_cd ? cwd : NULL) < 0) {
+                    fprintf(stderr, "No se pudo lanzar proceso para %s\n", files[i]);
                 } else {
-                    printf("Lanzado proceso para %s (active children=%d)\n", file, (int)children_count);
+                    printf("Lanzado proceso para %s (active children=%d)\n", files[i], (int)children_count);
+                    fflush(stdout);
                 }
             }
             /* wait until all children finish */
@@ -577,13 +682,74 @@ int main(int argc, char *argv[]) {
                 struct timespec ts = {0, 200000000}; /* 200ms */
                 nanosleep(&ts, NULL);
             }
+            if (mget_journal >= 0) {
+                close(mget_journal);
+                mget_journal = -1;
+                int pending = journal_end(jpath, keys, nfiles);
+                if (pending > 0)
+                    printf("mget: %d pendientes; repetir el mismo mget los retoma\n", pending);
+            }
+            for (int i = 0; i < nfiles; i++) free(keys[i]);
             printf("mget completo\n");
             continue;
         }
 
+        if (strcmp(tok, "mput") == 0) {
+            char *arg;
+            int active = fs.active, flags = 0;
+            glob_t g;
+            memset(&g, 0, sizeof(g));
+            while ((arg = strtok(NULL, " ")) != NULL) {
+                if (strcmp(arg, "-a") == 0) { active = 1; continue; }
+                int rc = glob(arg, flags, NULL, &g);
+                if (rc == GLOB_NOMATCH) printf("%s: sin coincidencias\n", arg);
+                else if (rc != 0) printf("%s: error expandiendo patrón\n", arg);
+                if (g.gl_pathc > 0) flags = GLOB_APPEND;
+            }
+            if (g.gl_pathc == 0) {
+                printf("Uso: mput [-a] <archivo|patrón> ...\n");
+                continue;
+            }
+            /* sólo archivos regulares */
+            char **files = malloc(g.gl_pathc * sizeof(char *));
+            int nfiles = 0;
+            for (size_t i = 0; files && i < g.gl_pathc; i++) {
+                struct stat st;
+                if (stat(g.gl_pathv[i], &st) == 0 && S_ISREG(st.st_mode))
+                    files[nfiles++] = g.gl_pathv[i];
+                else
+                    printf("%s: no es un archivo regular, se omite\n", g.gl_pathv[i]);
+            }
+            /* los workers suben al directorio del último cd, como mget */
+            char cwd[1024] = "";
+            if (remote_cd) remote_pwd(&fs, cwd, sizeof(cwd));
+            if (files) do_mput(host, service, user, pass, files, nfiles, active,
+                               remote_cd ? cwd : NULL);
+            free(files);
+            globfree(&g);
+            continue;
+        }
+
+        /* FXP - servidor actual -> otro servidor, sin pasar por este host */
+        if (strcmp(tok, "fxp") == 0) {
+            char *dhost = strtok(NULL, " ");
+            char *dport = strtok(NULL, " ");
+            char *src = strtok(NULL, " ");
+            char *dst = strtok(NULL, " ");
+            if (!src) { printf("Uso: fxp <host> <puerto> <remoto> [destino]\n"); continue; }
+            if (!dst) dst = src;
+            if (fxp_open(dhost, dport) < 0) {
+                fprintf(stderr, "fxp: %s\n", fxp_fs.errmsg);
+                continue;
+            }
+            if (ftp_fxp(&fs, &fxp_fs, src, dst) == 0) printf("fxp OK\n");
+            else fprintf(stderr, "fxp: %s\n", fs.errmsg);
+            continue;
+        }
+
         /* PWD - mostrar directorio remoto */
         if (strcmp(tok, "pwd") == 0 || strcmp(tok, "PWD") == 0) {
-            sendCmd(s, "PWD", res, sizeof(res));
+            ftp_cmd(&fs, "PWD");
             continue;
         }
 
@@ -591,9 +757,7 @@ int main(int argc, char *argv[]) {
         if (strcmp(tok, "mkd") == 0 || strcmp(tok, "MKD") == 0) {
             char *arg = strtok(NULL, " ");
             if (!arg) { printf("Uso: MKD <dir>\n"); continue; }
-            char cmdmk[256];
-            snprintf(cmdmk, sizeof(cmdmk), "MKD %s", arg);
-            sendCmd(s, cmdmk, res, sizeof(res));
+            ftp_cmd(&fs, "MKD %s", arg);
             continue;
         }
 
@@ -601,9 +765,7 @@ int main(int argc, char *argv[]) {
         if (strcmp(tok, "dele") == 0 || strcmp(tok, "DELE") == 0) {
             char *arg = strtok(NULL, " ");
             if (!arg) { printf("Uso: DELE <file>\n"); continue; }
-            char cmddel[256];
-            snprintf(cmddel, sizeof(cmddel), "DELE %s", arg);
-            sendCmd(s, cmddel, res, sizeof(res));
+            ftp_cmd(&fs, "DELE %s", arg);
             continue;
         }
 
@@ -614,40 +776,46 @@ int main(int argc, char *argv[]) {
             long off = atol(arg);
             if (off < 0) { printf("offset invalido\n"); continue; }
 
-            /* Asegurar modo binario antes de REST (servidores suelen rechazar REST en ASCII) */
-            char restres[LINELEN];
-            if (sendCmd(s, "TYPE I", restres, sizeof(restres)) < 0) {
-                fprintf(stderr, "Error estableciendo TYPE I\n");
-                continue;
-            }
+            /* el servidor valida el REST ahora; se reenvía antes de la RETR */
+            if (ftp_rest(&fs, off) == 0)
+                printf("REST guardado: %ld (se aplicará al siguiente RETR)\n", fs.restart_offset);
+            else
+                printf("%s\n", fs.errmsg);
+            continue;
+        }
 
-            /* enviar REST al servidor para validar si lo acepta */
-            char cmdrest[256];
-            snprintf(cmdrest, sizeof(cmdrest), "REST %ld", off);
-            int code = sendCmd(s, cmdrest, restres, sizeof(restres));
-            if (code < 0) { fprintf(stderr, "REST: error de comunicación\n"); continue; }
-            /* 3xx es OK (350 normalmente) */
-            if (code >= 300 && code < 400) {
-                restart_offset = off;
-                printf("REST guardado: %ld (se aplicará al siguiente RETR)\n", restart_offset);
-            } else {
-                printf("REST no aceptado por servidor: %s\n", restres);
-            }
+
+        /* modo de las conexiones de datos para el resto de la sesión */
+        if (strcmp(tok, "active") == 0 || strcmp(tok, "passive") == 0) {
+            ftp_active(&fs, tok[0] == 'a');
+            printf("Modo %s\n", fs.active ? "activo (PORT)" : "pasivo (PASV)");
             continue;
         }
 
+        /* TYPE A / TYPE I para get, put y mget */
+        if (strcmp(tok, "ascii") == 0 || strcmp(tok, "binary") == 0) {
+            if (ftp_type(&fs, tok[0] == 'a') < 0) fprintf(stderr, "%s: %s\n", tok, fs.errmsg);
+            continue;
+        }
+
+        /* modo de escritura de las descargas (ver diskwrite.c) */
+        if (strcmp(tok, "writer") == 0) {
+            char *arg = strtok(NULL, " ");
+            if (!arg) { printf("Uso: writer <cache|stream|direct>\n"); continue; }
+            if (ftp_writer(&fs, arg) < 0) printf("%s\n", fs.errmsg);
+            continue;
+        }
 
         if (strcmp(tok, "cd") == 0) {
             char *arg = strtok(NULL, " ");
             if (!arg) { printf("Uso: cd <dir>\n"); continue; }
-            snprintf(cmd, sizeof(cmd), "CWD %s", arg);
-            sendCmd(s, cmd, res, sizeof(res));
+            if (ftp_cmd(&fs, "CWD %s", arg) == 250) remote_cd = 1;
             continue;
         }
 
         if (strcmp(tok, "quit") == 0) {
-            sendCmd(s, "QUIT", res, sizeof(res));
-            close(s);
+            if (fxp_fs.ctrl >= 0) ftp_close(&fxp_fs);
+            ftp_close(&fs);
             break;
         }
 
@@ -656,5 +824,3 @@ int main(int argc, char *argv[]) {
 
     return 0;
 }
-
-
@@ -0,0 +1,192 @@
+/* crlf.c - ftp_crlf_to_lf, ftp_lf_to_crlf (conversión ASCII de libftpclient) */
+
+/*
+ * Conversión de fin de línea para TYPE A, hecha sobre el buffer de la
+ * transferencia mientras se mueve, sin una pasada extra sobre el archivo.
+ * Se recorre en bloques de 32 (AVX2) o 16 (SSE2) bytes: un bloque sin el
+ * carácter buscado se copia entero con una carga y un store, y uno que lo
+ * contiene se copia hasta esa posición y sólo ese byte se trata aparte.
+ * En otras arquitecturas queda el bucle escalar.
+ */
+
+#include <string.h>
+
+#include "ftpclient.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRLF_X86 1
+#include <immintrin.h>
+#endif
+
+/* ------------------ CRLF -> LF (descarga) ------------------ */
+
+/* tramo [i, n) escalar; devuelve la nueva posición de salida */
+static size_t crlf_tail(char *dst, size_t out, const char *src, size_t i, size_t n,
+                        int *pending_cr) {
+    for (; i < n; i++) {
+        if (src[i] != '\r') { dst[out++] = src[i]; continue; }
+        if (i + 1 == n) { *pending_cr = 1; break; }
+        if (src[i + 1] != '\n') dst[out++] = '\r';
+    }
+    return out;
+}
+
+#ifdef CRLF_X86
+__attribute__((target("avx2")))
+static size_t crlf_avx2(char *dst, const char *src, size_t n, int *pending_cr) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    size_t i = 0, out = 0;
+    while (i + 32 <= n) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, cr));
+        if (!m) {
+            _mm256_storeu_si256((__m256i *)(dst + out), v);
+            i += 32;
+            out += 32;
+            continue;
+        }
+        /* en el mismo buffer un store entero pisaría bytes aún sin leer */
+        unsigned pos = __builtin_ctz(m);
+        memmove(dst + out, src + i, pos);
+        out += pos;
+        i += pos;
+        if (i + 1 == n) { *pending_cr = 1; return out; }
+        if (src[i + 1] != '\n') dst[out++] = '\r';
+        i++;
+    }
+    return crlf_tail(dst, out, src, i, n, pending_cr);
+}
+#endif
+
+#if defined(CRLF_X86) && defined(__SSE2__)
+static size_t crlf_sse2(char *dst, const char *src, size_t n, int *pending_cr) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    size_t i = 0, out = 0;
+    while (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, cr));
+        if (!m) {
+            _mm_storeu_si128((__m128i *)(dst + out), v);
+            i += 16;
+            out += 16;
+            continue;
+        }
+        /* en el mismo buffer un store entero pisaría bytes aún sin leer */
+        unsigned pos = __builtin_ctz(m);
+        memmove(dst + out, src + i, pos);
+        out += pos;
+        i += pos;
+        if (i + 1 == n) { *pending_cr = 1; return out; }
+        if (src[i + 1] != '\n') dst[out++] = '\r';
+        i++;
+    }
+    return crlf_tail(dst, out, src, i, n, pending_cr);
+}
+#endif
+
+/*
+ * Quita el CR de cada CRLF. Un CR al final del bloque queda en *pending_cr
+ * hasta ver el byte siguiente (pasar n = 0 al terminar para soltarlo).
+ * Admite dst == src - 1 (conversión en el mismo buffer, dejando un byte
+ * libre delante para ese CR); la salida ocupa como mucho n + 1 bytes.
+ */
+size_t ftp_crlf_to_lf(char *dst, const char *src, size_t n, int *pending_cr) {
+    size_t out = 0;
+    if (*pending_cr) {
+        *pending_cr = 0;
+        if (n == 0 || src[0] != '\n') dst[out++] = '\r';
+    }
+    if (n == 0) return out;
+#ifdef CRLF_X86
+    if (__builtin_cpu_supports("avx2")) return out + crlf_avx2(dst + out, src, n, pending_cr);
+#endif
+#if defined(CRLF_X86) && defined(__SSE2__)
+    return out + crlf_sse2(dst + out, src, n, pending_cr);
+#else
+    return crlf_tail(dst, out, src, 0, n, pending_cr);
+#endif
+}
+
+/* ------------------ LF -> CRLF (subida) ------------------ */
+
+static size_t lf_tail(char *dst, size_t out, const char *src, size_t i, size_t n,
+                      int *last_cr) {
+    for (; i < n; i++) {
+        if (src[i] == '\n' && !*last_cr) dst[out++] = '\r';
+        *last_cr = src[i] == '\r';
+        dst[out++] = src[i];
+    }
+    return out;
+}
+
+#ifdef CRLF_X86
+__attribute__((target("avx2")))
+static size_t lf_avx2(char *dst, const char *src, size_t n, int *last_cr) {
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = 0, out = 0;
+    while (i + 32 <= n) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, lf));
+        _mm256_storeu_si256((__m256i *)(dst + out), v);
+        if (!m) {
+            *last_cr = src[i + 31] == '\r';
+            i += 32;
+            out += 32;
+            continue;
+        }
+        unsigned pos = __builtin_ctz(m);
+        if (pos) *last_cr = src[i + pos - 1] == '\r';
+        out += pos;
+        i += pos;
+        if (!*last_cr) dst[out++] = '\r';
+        dst[out++] = '\n';
+        *last_cr = 0;
+        i++;
+    }
+    return lf_tail(dst, out, src, i, n, last_cr);
+}
+#endif
+
+#if defined(CRLF_X86) && defined(__SSE2__)
+static size_t lf_sse2(char *dst, const char *src, size_t n, int *last_cr) {
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = 0, out = 0;
+    while (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+        _mm_storeu_si128((__m128i *)(dst + out), v);
+        if (!m) {
+            *last_cr = src[i + 15] == '\r';
+            i += 16;
+            out += 16;
+            continue;
+        }
+        unsigned pos = __builtin_ctz(m);
+        if (pos) *last_cr = src[i + pos - 1] == '\r';
+        out += pos;
+        i += pos;
+        if (!*last_cr) dst[out++] = '\r';
+        dst[out++] = '\n';
+        *last_cr = 0;
+        i++;
+    }
+    return lf_tail(dst, out, src, i, n, last_cr);
+}
+#endif
+
+/*
+ * LF sin CR delante -> CRLF; los CRLF que ya vienen en el archivo no se
+ * duplican. *last_cr recuerda si el bloque anterior terminó en CR.
+ * dst necesita 2 * n bytes; src puede estar en la mitad alta de ese mismo
+ * buffer (src >= dst + n): la salida nunca alcanza lo que falta leer.
+ */
+size_t ftp_lf_to_crlf(char *dst, const char *src, size_t n, int *last_cr) {
+#ifdef CRLF_X86
+    if (__builtin_cpu_supports("avx2")) return lf_avx2(dst, src, n, last_cr);
+#endif
+#if defined(CRLF_X86) && defined(__SSE2__)
+    return lf_sse2(dst, src, n, last_cr);
+#else
+    return lf_tail(dst, 0, src, 0, n, last_cr);
+#endif
+}
@@ -0,0 +1,1164 @@
+/* ftpclient.c - sesiones FTP y transferencias no bloqueantes (libftpclient) */
+
+/*
+ * Toda la lógica de protocolo del cliente vive aquí; TCPftp.c y el daemon
+ * son sólo frontends. A diferencia de connectTCP()/errexit(), nada en esta
+ * biblioteca termina el proceso, para que pueda enlazarse en servicios.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <time.h>
+
+#include "ftpclient.h"
+
+#define ACCEPT_SECS 8       /* espera de la conexión de datos en PORT */
+#define ABOR_MS     2000    /* espera de respuestas tras ABOR         */
+#define RETRY_MAX   30      /* tope de la espera entre reintentos (s) */
+#define FXP_TAIL_MS 60000   /* confirmación del destino tras la del origen */
+
+/* ------------------ errores ------------------ */
+static int ftp_fail(ftp_session *fs, const char *fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+
+static int ftp_fail(ftp_session *fs, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(fs->errmsg, sizeof(fs->errmsg), fmt, args);
+    va_end(args);
+    return -1;
+}
+
+/* ------------------ sockets ------------------ */
+static ssize_t send_all(int fd, const void *buf, size_t len) {
+    size_t total = 0;
+    const char *p = buf;
+    while (total < len) {
+        /* MSG_NOSIGNAL: la aplicación no tiene por qué ignorar SIGPIPE */
+        ssize_t n = send(fd, p + total, len - total, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total += n;
+    }
+    return (ssize_t)total;
+}
+
+static ssize_t write_all(int fd, const void *buf, size_t len) {
+    size_t total = 0;
+    const char *p = buf;
+    while (total < len) {
+        ssize_t n = write(fd, p + total, len - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total += n;
+    }
+    return (ssize_t)total;
+}
+
+/* conectar (IPv4, como PASV/PORT); con 'nonblock' devuelve en EINPROGRESS */
+static int dial(ftp_session *fs, const char *host, const char *service, int nonblock) {
+    struct addrinfo hints, *res, *ai;
+    int s = -1, rc;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((rc = getaddrinfo(host, service, &hints, &res)) != 0)
+        return ftp_fail(fs, "%s:%s: %s", host, service, gai_strerror(rc));
+    for (ai = res; ai; ai = ai->ai_next) {
+        s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s < 0) continue;
+        if (nonblock) fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+        if (connect(s, ai->ai_addr, ai->ai_addrlen) == 0 ||
+            (nonblock && errno == EINPROGRESS))
+            break;
+        rc = errno;
+        close(s);
+        s = -1;
+        errno = rc;
+    }
+    freeaddrinfo(res);
+    if (s < 0)
+        return ftp_fail(fs, "no se pudo conectar a %s:%s: %s", host, service, strerror(errno));
+    /*
+     * keepalive: un extremo que desaparece sin FIN ni RST (enlace caído,
+     * host apagado) da ETIMEDOUT en ~1 min en vez de dejar recv() colgado
+     */
+    int on = 1, idle = 30, intvl = 10, cnt = 3;
+    setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(s, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(s, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, sizeof(intvl));
+    setsockopt(s, IPPROTO_TCP, TCP_KEEPCNT, &cnt, sizeof(cnt));
+    return s;
+}
+
+/* ------------------ respuestas del control ------------------ */
+
+/* extrae una línea completa del buffer; 0 si todavía no hay */
+static int take_line(ftp_session *fs, char *line, size_t n) {
+    char *nl = memchr(fs->rbuf, '\n', fs->rlen);
+    if (!nl) {
+        /* línea más larga que el buffer: se corta */
+        if (fs->rlen < sizeof(fs->rbuf)) return 0;
+        nl = fs->rbuf + fs->rlen - 1;
+    }
+    size_t len = nl - fs->rbuf + 1;
+    size_t c = len < n ? len : n - 1;
+    memcpy(line, fs->rbuf, c);
+    line[c] = '\0';
+    memmove(fs->rbuf, fs->rbuf + len, fs->rlen - len);
+    fs->rlen -= len;
+    return 1;
+}
+
+/* consume las líneas recibidas; devuelve el código al completar una respuesta */
+static int parse_reply(ftp_session *fs) {
+    char line[FTP_LINELEN];
+    while (take_line(fs, line, sizeof(line))) {
+        if (fs->log) { fputs(line, fs->log); fflush(fs->log); }
+        if (strlen(line) < 4 || !isdigit((unsigned char)line[0]) ||
+            !isdigit((unsigned char)line[1]) || !isdigit((unsigned char)line[2]))
+            continue;
+        int code = (line[0]-'0')*100 + (line[1]-'0')*10 + (line[2]-'0');
+        /* "123-..." abre una respuesta multilínea que cierra "123 ..." */
+        if (!fs->mline && line[3] == '-') { fs->mline = code; continue; }
+        if (fs->mline && (code != fs->mline || line[3] != ' ')) continue;
+        fs->mline = 0;
+        snprintf(fs->reply, sizeof(fs->reply), "%s", line);
+        fs->reply[strcspn(fs->reply, "\r\n")] = '\0';
+        fs->code = code;
+        return code;
+    }
+    return 0;
+}
+
+/* lee lo disponible del control; sólo bloquea si 'block' */
+static int fill_reply(ftp_session *fs, int block) {
+    ssize_t n;
+    if (fs->ctrl < 0) return ftp_fail(fs, "sesión cerrada");
+    if (fs->rlen == sizeof(fs->rbuf)) return 0;
+    do {
+        n = recv(fs->ctrl, fs->rbuf + fs->rlen, sizeof(fs->rbuf) - fs->rlen,
+                 block ? 0 : MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+    if (n == 0) return ftp_fail(fs, "el servidor cerró la conexión de control");
+    if (n < 0) {
+        if (!block && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        return ftp_fail(fs, "recv: %s", strerror(errno));
+    }
+    fs->rlen += n;
+    return 1;
+}
+
+int ftp_reply(ftp_session *fs) {
+    int code;
+    while ((code = parse_reply(fs)) == 0)
+        if (fill_reply(fs, 1) < 0) return -1;
+    return code;
+}
+
+/* respuesta sin bloquear: código, 0 si aún no llegó, -1 si error */
+static int reply_nb(ftp_session *fs) {
+    int code = parse_reply(fs);
+    if (code) return code;
+    if (fill_reply(fs, 0) < 0) return -1;
+    return parse_reply(fs);
+}
+
+/* respuesta con límite de tiempo: 0 si vence */
+static int reply_timeout(ftp_session *fs, int ms) {
+    int code;
+    while ((code = parse_reply(fs)) == 0) {
+        struct pollfd pfd = { fs->ctrl, POLLIN, 0 };
+        int r = poll(&pfd, 1, ms);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return 0;
+        if (fill_reply(fs, 1) < 0) return -1;
+    }
+    return code;
+}
+
+static int vsend_cmd(ftp_session *fs, const char *fmt, va_list args) {
+    char buf[FTP_LINELEN + 2];
+    int n = vsnprintf(buf, FTP_LINELEN, fmt, args);
+    if (n < 0 || n >= FTP_LINELEN) return ftp_fail(fs, "comando demasiado largo");
+    memcpy(buf + n, "\r\n", 2);
+    if (fs->ctrl < 0) return ftp_fail(fs, "sesión cerrada");
+    if (send_all(fs->ctrl, buf, n + 2) < 0)
+        return ftp_fail(fs, "send: %s", strerror(errno));
+    return 0;
+}
+
+static int send_cmd(ftp_session *fs, const char *fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+
+static int send_cmd(ftp_session *fs, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int rc = vsend_cmd(fs, fmt, args);
+    va_end(args);
+    return rc;
+}
+
+int ftp_cmd(ftp_session *fs, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int rc = vsend_cmd(fs, fmt, args);
+    va_end(args);
+    if (rc < 0) return -1;
+    return ftp_reply(fs);
+}
+
+/*
+ * Como ftp_cmd() pero sin esperar más de 'ms' la respuesta (keepalive de un
+ * control que pudo morir sin FIN ni RST). Si vence devuelve -1 y la sesión
+ * queda desincronizada: hay que cerrarla.
+ */
+int ftp_cmd_timeout(ftp_session *fs, int ms, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int rc = vsend_cmd(fs, fmt, args);
+    va_end(args);
+    if (rc < 0) return -1;
+    int code = reply_timeout(fs, ms);
+    if (code == 0) return ftp_fail(fs, "sin respuesta del servidor en %d ms", ms);
+    return code;
+}
+
+/* ------------------ modo activo (PORT) ------------------ */
+/*
+ * La IP local que anunciamos en PORT es la del socket de control (el kernel
+ * ya eligió la interfaz hacia el servidor) y se averigua una vez por
+ * sesión. Los sockets se enlazan por adelantado y se reponen al terminar
+ * cada transferencia, fuera del camino crítico del siguiente archivo, pero
+ * listen() se llama sólo al usarlos: un puerto del pool no acepta
+ * conexiones mientras la sesión está ociosa. Al aceptar se comprueba que
+ * la conexión venga de la IP del servidor.
+ */
+static int local_addr(ftp_session *fs) {
+    socklen_t len = sizeof(fs->local_addr);
+    if (fs->addr_known) return 0;
+    if (getsockname(fs->ctrl, (struct sockaddr *)&fs->local_addr, &len) < 0)
+        return ftp_fail(fs, "getsockname(control): %s", strerror(errno));
+    if (fs->local_addr.sin_family != AF_INET)
+        return ftp_fail(fs, "PORT: IPv6 no soportado");
+    fs->addr_known = 1;
+    return 0;
+}
+
+/* socket no bloqueante enlazado a un puerto efímero (todavía sin listen) */
+static int listen_new(ftp_session *fs, unsigned short *port) {
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) return ftp_fail(fs, "socket: %s", strerror(errno));
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr = fs->local_addr.sin_addr;
+    sin.sin_port = htons(0); /* 0 => kernel elige puerto */
+    if (bind(s, (struct sockaddr *)&sin, sizeof(sin)) < 0 ||
+        getsockname(s, (struct sockaddr *)&sin, &len) < 0) {
+        ftp_fail(fs, "listener PORT: %s", strerror(errno));
+        close(s);
+        return -1;
+    }
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+    *port = ntohs(sin.sin_port);
+    return s;
+}
+
+static void listen_fill(ftp_session *fs) {
+    if (!fs->active || fs->ctrl < 0 || local_addr(fs) < 0) return;
+    while (fs->nlpool < FTP_LISTEN_POOL) {
+        int s = listen_new(fs, &fs->lport[fs->nlpool]);
+        if (s < 0) return;
+        fs->lpool[fs->nlpool++] = s;
+    }
+}
+
+/* listener para una transferencia; 'sin' queda listo para port_arg() */
+static int listen_take(ftp_session *fs, struct sockaddr_in *sin) {
+    unsigned short port;
+    int s;
+    if (local_addr(fs) < 0) return -1;
+    if (fs->nlpool > 0) {
+        s = fs->lpool[--fs->nlpool];
+        port = fs->lport[fs->nlpool];
+    } else if ((s = listen_new(fs, &port)) < 0) {
+        return -1;
+    }
+    if (listen(s, 1) < 0) {
+        ftp_fail(fs, "listener PORT: %s", strerror(errno));
+        close(s);
+        return -1;
+    }
+    *sin = fs->local_addr;
+    sin->sin_port = htons(port);
+    return s;
+}
+
+/* la conexión de datos tiene que venir del mismo host que el control */
+static int peer_ok(ftp_session *fs, int d) {
+    struct sockaddr_in a, b;
+    socklen_t la = sizeof(a), lb = sizeof(b);
+    if (getpeername(d, (struct sockaddr *)&a, &la) < 0 ||
+        getpeername(fs->ctrl, (struct sockaddr *)&b, &lb) < 0)
+        return 0;
+    return a.sin_family == AF_INET && b.sin_family == AF_INET &&
+           a.sin_addr.s_addr == b.sin_addr.s_addr;
+}
+
+static void listen_drop(ftp_session *fs) {
+    while (fs->nlpool > 0) close(fs->lpool[--fs->nlpool]);
+}
+
+int ftp_active(ftp_session *fs, int on) {
+    fs->active = on;
+    if (on) listen_fill(fs);
+    else listen_drop(fs);
+    return 0;
+}
+
+/* ------------------ sesión ------------------ */
+void ftp_init(ftp_session *fs) {
+    memset(fs, 0, sizeof(*fs));
+    fs->ctrl = -1;
+    fs->retries = FTP_RETRIES_DEFAULT;
+    fs->idle = FTP_IDLE_DEFAULT;
+}
+
+int ftp_open(ftp_session *fs, const char *host, const char *service) {
+    fs->rlen = 0;
+    fs->mline = 0;
+    fs->addr_known = 0;
+    listen_drop(fs);
+    if ((fs->ctrl = dial(fs, host, service, 0)) < 0) return -1;
+    int code = ftp_reply(fs);
+    if (code < 0 || code >= 400) {
+        if (code >= 400) ftp_fail(fs, "conexión rechazada: %s", fs->reply);
+        close(fs->ctrl);
+        fs->ctrl = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int ftp_login(ftp_session *fs, const char *user, const char *pass) {
+    int code = ftp_cmd(fs, "USER %s", user);
+    if (code == 331 || code == 332) code = ftp_cmd(fs, "PASS %s", pass);
+    if (code < 0) return -1;
+    if (code < 200 || code >= 300) return ftp_fail(fs, "login rechazado: %s", fs->reply);
+    return 0;
+}
+
+void ftp_close(ftp_session *fs) {
+    if (fs->xfer) ftp_xfer_free(fs->xfer);
+    if (fs->ctrl >= 0) {
+        /* un control muerto sin FIN no debe colgar el cierre */
+        if (send_cmd(fs, "QUIT") == 0) reply_timeout(fs, ABOR_MS);
+        close(fs->ctrl);
+    }
+    listen_drop(fs);
+    fs->ctrl = -1;
+    fs->rlen = 0;
+}
+
+int ftp_alive(ftp_session *fs) {
+    struct pollfd pfd = { fs->ctrl, POLLIN, 0 };
+    return fs->ctrl >= 0 && fs->rlen == 0 && poll(&pfd, 1, 0) == 0;
+}
+
+/* TYPE A convierte los fines de línea en cada get/put/dir de la sesión */
+int ftp_type(ftp_session *fs, int ascii) {
+    int code = ftp_cmd(fs, ascii ? "TYPE A" : "TYPE I");
+    if (code < 0) return -1;
+    if (code >= 400) return ftp_fail(fs, "TYPE: %s", fs->reply);
+    fs->ascii = ascii;
+    return 0;
+}
+
+/* cómo se escriben las descargas de la sesión (ver diskwrite.c) */
+int ftp_writer(ftp_session *fs, const char *mode) {
+    if (strcmp(mode, "cache") == 0) fs->wmode = FTP_WRITE_CACHE;
+    else if (strcmp(mode, "stream") == 0) fs->wmode = FTP_WRITE_STREAM;
+    else if (strcmp(mode, "direct") == 0) fs->wmode = FTP_WRITE_DIRECT;
+    else return ftp_fail(fs, "modo de escritura desconocido: %s", mode);
+    return 0;
+}
+
+/* put/pput: cuántas veces reintentar tras un corte de la transferencia */
+int ftp_retries(ftp_session *fs, int n) {
+    fs->retries = n < 0 ? 0 : n;
+    return 0;
+}
+
+/* transferencias bloqueantes: plazo sin actividad en segundos, 0 = ninguno */
+int ftp_idle(ftp_session *fs, int secs) {
+    fs->idle = secs < 0 ? 0 : secs;
+    return 0;
+}
+
+/* REST validado por el servidor; se aplica en la próxima RETR */
+int ftp_rest(ftp_session *fs, long offset) {
+    /* servidores suelen rechazar REST en ASCII */
+    if (ftp_type(fs, 0) < 0) return -1;
+    int code = ftp_cmd(fs, "REST %ld", offset);
+    if (code < 0) return -1;
+    if (code < 300 || code >= 400) return ftp_fail(fs, "REST no aceptado: %s", fs->reply);
+    fs->restart_offset = offset;
+    return 0;
+}
+
+/* "227 ... (h1,h2,h3,h4,p1,p2)" -> dirección IPv4 */
+static int parse_pasv(ftp_session *fs, struct sockaddr_in *sin) {
+    int h1, h2, h3, h4, p1, p2;
+    char host[64];
+    char *p = strchr(fs->reply, '(');
+    if (!p || sscanf(p + 1, "%d,%d,%d,%d,%d,%d", &h1, &h2, &h3, &h4, &p1, &p2) != 6)
+        return ftp_fail(fs, "PASV: respuesta malformada: %s", fs->reply);
+    snprintf(host, sizeof(host), "%d.%d.%d.%d", h1, h2, h3, h4);
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons((unsigned short)(p1 * 256 + p2));
+    if (inet_pton(AF_INET, host, &sin->sin_addr) != 1)
+        return ftp_fail(fs, "PASV: dirección inválida: %s", fs->reply);
+    return 0;
+}
+
+/* dirección IPv4 -> argumento de PORT "h1,h2,h3,h4,p1,p2" */
+static void port_arg(char *buf, size_t n, const struct sockaddr_in *sin) {
+    char ip_commas[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &sin->sin_addr, ip_commas, sizeof(ip_commas));
+    for (size_t i = 0; i < strlen(ip_commas); ++i) if (ip_commas[i]=='.') ip_commas[i]=',';
+    unsigned short port = ntohs(sin->sin_port);
+    snprintf(buf, n, "%s,%d,%d", ip_commas, port / 256, port % 256);
+}
+
+/* ------------------ transferencias no bloqueantes ------------------ */
+enum { X_SIZE, X_REST, X_PASV, X_PORT, X_CONNECT, X_PRELIM, X_ACCEPT, X_DATA, X_FINAL, X_END };
+enum { K_GET, K_PUT, K_LIST };
+
+struct ftp_xfer {
+    ftp_session    *fs;
+    int             kind, state, status;
+    int             data;               /* socket de datos              */
+    int             listen;             /* PORT: esperando al servidor  */
+    long long       deadline;           /* PORT: límite para el accept  */
+    int             lfd, own_lfd;       /* descriptor local             */
+    int             final_seen;         /* 226 llegó antes que el EOF   */
+    long            offset;             /* REST aplicado                */
+    int             resume, append;     /* put: continuar; APPE sin REST */
+    int             port;               /* pput: PORT aunque la sesión no */
+    long long       size;               /* SIZE del remoto, -1 = no     */
+    ftp_dw         *dw;                 /* get con FTP_WRITE_STREAM/... */
+    long long       bytes;
+    int             ascii, cr;          /* TYPE A y CR del bloque previo */
+    int             splice;             /* salida a pipe con splice()   */
+    char            remote[FTP_LINELEN - 16];
+    char            local[4096];
+    char           *buf;
+    size_t          blen, boff;         /* put: pendiente de enviar     */
+    ftp_progress_cb progress;
+    ftp_done_cb     done;
+    void           *arg;
+};
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static int xfer_end(ftp_xfer *x, int status) {
+    if (x->data >= 0) { close(x->data); x->data = -1; }
+    if (x->listen >= 0) { close(x->listen); x->listen = -1; }
+    if (x->own_lfd && x->lfd >= 0) {
+        if (close(x->lfd) < 0 && status == FTP_XFER_DONE)
+            status = ftp_fail(x->fs, "%s: %s", x->local, strerror(errno));
+        x->lfd = -1;
+    }
+    if (x->dw) {
+        if (ftp_dw_close(x->dw) < 0 && status == FTP_XFER_DONE)
+            status = ftp_fail(x->fs, "%s: %s", x->local, strerror(errno));
+        x->dw = NULL;
+    }
+    x->state = X_END;
+    x->status = status;
+    if (x->fs->xfer == x) x->fs->xfer = NULL;
+    listen_fill(x->fs);
+    if (x->done) x->done(x, status, x->arg);
+    return status;
+}
+
+/* el servidor puede estar enviando: cerrar datos, ABOR y resincronizar */
+static void xfer_abort(ftp_xfer *x) {
+    ftp_session *fs = x->fs;
+    int pending = x->state;
+    if (x->data >= 0) { close(x->data); x->data = -1; }
+
+    if (pending == X_SIZE || pending == X_REST || pending == X_PASV || pending == X_PORT) {
+        reply_timeout(fs, ABOR_MS);
+    } else if (pending != X_CONNECT) {
+        char keep[sizeof(fs->errmsg)];
+        memcpy(keep, fs->errmsg, sizeof(keep));
+        if (send_cmd(fs, "ABOR") == 0) {
+            /* 426+226, 226+225 o 550+225 según el momento del ABOR */
+            int fours = 0, twos = 0, code;
+            while ((code = reply_timeout(fs, ABOR_MS)) > 0) {
+                if (code >= 400) fours++;
+                else if (code >= 200 && (code == 225 || fours || ++twos >= 2)) break;
+            }
+        }
+        memcpy(fs->errmsg, keep, sizeof(keep));
+    }
+}
+
+static int xfer_fail(ftp_xfer *x) {
+    if (x->state != X_END) xfer_abort(x);
+    return xfer_end(x, FTP_XFER_ERROR);
+}
+
+/* PASV, o PORT con un listener del pool */
+static int xfer_dataconn(ftp_xfer *x) {
+    ftp_session *fs = x->fs;
+    struct sockaddr_in sin;
+    char arg[64];
+    if (!fs->active && !x->port) {
+        x->state = X_PASV;
+        return send_cmd(fs, "PASV");
+    }
+    if ((x->listen = listen_take(fs, &sin)) < 0) return -1;
+    port_arg(arg, sizeof(arg), &sin);
+    x->state = X_PORT;
+    return send_cmd(fs, "PORT %s", arg);
+}
+
+static int xfer_command(ftp_xfer *x) {
+    if (x->kind == K_LIST) return send_cmd(x->fs, "LIST");
+    return send_cmd(x->fs, "%s %s", x->kind == K_GET ? "RETR" : x->append ? "APPE" : "STOR",
+                    x->remote);
+}
+
+/* REST si hay que reanudar, si no directamente la conexión de datos */
+static int xfer_start(ftp_xfer *x) {
+    if (x->offset > 0) {
+        x->state = X_REST;
+        return send_cmd(x->fs, "REST %ld", x->offset);
+    }
+    return xfer_dataconn(x);
+}
+
+static ftp_xfer *xfer_new(ftp_session *fs, int kind, const char *remote,
+                          const char *local, int lfd, int resume, int port) {
+    if (fs->ctrl < 0) { ftp_fail(fs, "sesión cerrada"); return NULL; }
+    if (fs->xfer) { ftp_fail(fs, "ya hay una transferencia en curso"); return NULL; }
+    if (remote && strlen(remote) >= sizeof(((ftp_xfer *)0)->remote)) {
+        ftp_fail(fs, "nombre remoto demasiado largo");
+        return NULL;
+    }
+    ftp_xfer *x = calloc(1, sizeof(*x));
+    /* en ASCII la subida puede doblar el tamaño (LF -> CRLF) */
+    if (!x || !(x->buf = malloc(fs->ascii ? 2 * FTP_BUFSIZE : FTP_BUFSIZE))) {
+        free(x);
+        ftp_fail(fs, "sin memoria");
+        return NULL;
+    }
+    x->fs = fs;
+    x->kind = kind;
+    x->ascii = fs->ascii;
+    x->data = -1;
+    x->listen = -1;
+    x->lfd = lfd;
+    x->port = port;
+    /* en ASCII los offsets local y remoto no coinciden */
+    x->resume = resume && !x->ascii;
+    if (remote) snprintf(x->remote, sizeof(x->remote), "%s", remote);
+    if (local) snprintf(x->local, sizeof(x->local), "%s", local);
+    fs->xfer = x;
+
+    int rc;
+    x->size = -1;
+    if (kind == K_GET) x->offset = fs->restart_offset;
+    fs->restart_offset = 0;
+    if ((kind == K_GET && lfd < 0 && fs->wmode != FTP_WRITE_CACHE && !x->ascii) ||
+        x->resume) {
+        /* get: reservar el archivo entero; put: saber cuánto ya llegó */
+        x->state = X_SIZE;
+        rc = send_cmd(fs, "SIZE %s", x->remote);
+    } else {
+        rc = xfer_start(x);
+    }
+    if (rc < 0) {
+        if (x->listen >= 0) close(x->listen);
+        x->state = X_END;
+        fs->xfer = NULL;
+        ftp_xfer_free(x);
+        return NULL;
+    }
+    return x;
+}
+
+ftp_xfer *ftp_xfer_get(ftp_session *fs, const char *remote, const char *local) {
+    return xfer_new(fs, K_GET, remote, local, -1, 0, 0);
+}
+
+/* get a un descriptor ya abierto (stdout, pipe); el llamador lo cierra */
+ftp_xfer *ftp_xfer_get_fd(ftp_session *fs, const char *remote, int outfd) {
+    return xfer_new(fs, K_GET, remote, NULL, outfd, 0, 0);
+}
+
+static ftp_xfer *xfer_put(ftp_session *fs, const char *local, const char *remote,
+                          int resume, int port) {
+    /* el archivo local se abre antes de tocar el servidor */
+    int fd = open(local, O_RDONLY);
+    if (fd < 0) { ftp_fail(fs, "%s: %s", local, strerror(errno)); return NULL; }
+    ftp_xfer *x = xfer_new(fs, K_PUT, remote, local, fd, resume, port);
+    if (!x) { close(fd); return NULL; }
+    x->own_lfd = 1;
+    return x;
+}
+
+ftp_xfer *ftp_xfer_put(ftp_session *fs, const char *local, const char *remote) {
+    return xfer_put(fs, local, remote, 0, 0);
+}
+
+/* SIZE del remoto y se sube sólo lo que falta */
+ftp_xfer *ftp_xfer_put_resume(ftp_session *fs, const char *local, const char *remote) {
+    return xfer_put(fs, local, remote, 1, 0);
+}
+
+ftp_xfer *ftp_xfer_list(ftp_session *fs, int outfd) {
+    return xfer_new(fs, K_LIST, NULL, NULL, outfd, 0, 0);
+}
+
+void ftp_xfer_callbacks(ftp_xfer *x, ftp_progress_cb progress,
+                        ftp_done_cb done, void *arg) {
+    x->progress = progress;
+    x->done = done;
+    x->arg = arg;
+}
+
+long long ftp_xfer_bytes(ftp_xfer *x) {
+    return x->bytes;
+}
+
+/* hasta dónde se puede reanudar con REST; -1 en ASCII (no hay equivalencia) */
+long long ftp_xfer_offset(ftp_xfer *x) {
+    if (x->ascii) return -1;
+    return x->offset + x->bytes - (x->dw ? ftp_dw_pending(x->dw) : 0);
+}
+
+int ftp_xfer_fd(ftp_xfer *x, short *events) {
+    switch (x->state) {
+    case X_CONNECT:
+        *events = POLLOUT;
+        return x->data;
+    case X_ACCEPT:
+        *events = POLLIN;
+        return x->listen;
+    case X_DATA:
+        *events = x->kind == K_PUT ? POLLOUT : POLLIN;
+        return x->data;
+    case X_END:
+        *events = 0;
+        return -1;
+    default:
+        *events = POLLIN;
+        return x->fs->ctrl;
+    }
+}
+
+/* get/list: abrir destino sólo cuando el servidor aceptó la RETR */
+static int open_local(ftp_xfer *x) {
+    struct stat st;
+    if (x->kind == K_PUT) {
+        if (x->offset > 0 && lseek(x->lfd, x->offset, SEEK_SET) < 0)
+            return ftp_fail(x->fs, "%s: %s", x->local, strerror(errno));
+        return 0;
+    }
+    if (x->lfd < 0 && x->fs->wmode != FTP_WRITE_CACHE && !x->ascii) {
+        x->dw = ftp_dw_open(x->local, x->fs->wmode, x->offset, x->size);
+        if (!x->dw) return ftp_fail(x->fs, "%s: %s", x->local, strerror(errno));
+        return 0;
+    }
+    if (x->lfd < 0) {
+        /* sin O_TRUNC: si reanudamos hay que conservar lo ya descargado */
+        int fd = open(x->local, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) return ftp_fail(x->fs, "%s: %s", x->local, strerror(errno));
+        if (x->offset > 0 ? lseek(fd, x->offset, SEEK_SET) < 0 : ftruncate(fd, 0) < 0) {
+            ftp_fail(x->fs, "%s: %s", x->local, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        x->lfd = fd;
+        x->own_lfd = 1;
+    }
+    /* salida a un pipe: splice() mueve del socket sin pasar por x->buf */
+    x->splice = !x->ascii && fstat(x->lfd, &st) == 0 && S_ISFIFO(st.st_mode);
+    return 0;
+}
+
+/* mueve datos sin bloquear: -1 error, 1 EOF, 0 seguir */
+static int data_recv(ftp_xfer *x) {
+    for (int i = 0; i < 16; i++) {
+        if (x->splice) {
+            ssize_t n = ftp_splice(x->data, x->lfd, FTP_BUFSIZE);
+            if (n == 0) return 1;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+                /* sin soporte para este par de descriptores: copia normal */
+                if (errno == EINVAL || errno == ENOSYS) { x->splice = 0; continue; }
+                return ftp_fail(x->fs, "splice: %s", strerror(errno));
+            }
+            x->bytes += n;
+            continue;
+        }
+        /* ASCII: un byte libre delante para el CR pendiente del bloque previo */
+        char *p = x->buf + x->ascii;
+        ssize_t n = recv(x->data, p, FTP_BUFSIZE - x->ascii, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return ftp_fail(x->fs, "recv datos: %s", strerror(errno));
+        }
+        size_t len = n;
+        if (x->ascii) {
+            len = ftp_crlf_to_lf(x->buf, p, n, &x->cr);
+            p = x->buf;
+        }
+        if (len > 0 && (x->dw ? ftp_dw_write(x->dw, p, len)
+                              : write_all(x->lfd, p, len)) < 0)
+            return ftp_fail(x->fs, "%s: %s", x->local[0] ? x->local : "salida",
+                            strerror(errno));
+        if (n == 0) return 1;
+        x->bytes += n;
+    }
+    return 0;
+}
+
+static int data_send(ftp_xfer *x) {
+    for (int i = 0; i < 16; i++) {
+        if (x->boff == x->blen) {
+            /* ASCII: se lee en la mitad alta y se convierte a la baja */
+            char *p = x->ascii ? x->buf + FTP_BUFSIZE : x->buf;
+            ssize_t n = read(x->lfd, p, FTP_BUFSIZE);
+            if (n == 0) return 1;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return ftp_fail(x->fs, "%s: %s", x->local, strerror(errno));
+            }
+            x->blen = x->ascii ? ftp_lf_to_crlf(x->buf, p, n, &x->cr) : (size_t)n;
+            x->boff = 0;
+        }
+        ssize_t n = send(x->data, x->buf + x->boff, x->blen - x->boff,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return ftp_fail(x->fs, "send datos: %s", strerror(errno));
+        }
+        x->boff += n;
+        x->bytes += n;
+    }
+    return 0;
+}
+
+int ftp_xfer_step(ftp_xfer *x) {
+    ftp_session *fs = x->fs;
+    struct sockaddr_in sin;
+    char host[INET_ADDRSTRLEN], port[16];
+    int code, r;
+
+    while (x->state != X_END) {
+        switch (x->state) {
+        case X_SIZE:
+            if ((code = reply_nb(fs)) == 0) return FTP_XFER_RUNNING;
+            if (code < 0) return xfer_end(x, FTP_XFER_ERROR);
+            /* "213 <bytes>"; sin SIZE se descarga igual, sin reservar */
+            if (code == 213 && sscanf(fs->reply + 4, "%lld", &x->size) != 1) x->size = -1;
+            if (x->kind == K_PUT) {
+                struct stat st;
+                if (fstat(x->lfd, &st) < 0) {
+                    ftp_fail(fs, "%s: %s", x->local, strerror(errno));
+                    return xfer_end(x, FTP_XFER_ERROR);
+                }
+                /* ya completo; más grande que el local = otro archivo, se reemplaza */
+                if (x->size > 0 && x->size == st.st_size) return xfer_end(x, FTP_XFER_DONE);
+                if (x->size > 0 && x->size < st.st_size) x->offset = x->size;
+            }
+            if (xfer_start(x) < 0) return xfer_end(x, FTP_XFER_ERROR);
+            break;
+
+        case X_REST:
+            if ((code = reply_nb(fs)) == 0) return FTP_XFER_RUNNING;
+            if (code < 0) return xfer_end(x, FTP_XFER_ERROR);
+            /* REST rechazado: get desde el principio, put con APPE */
+            if (code < 300 || code >= 400) {
+                if (x->kind == K_PUT) x->append = 1;
+                else x->offset = 0;
+            }
+            if (xfer_dataconn(x) < 0) return xfer_end(x, FTP_XFER_ERROR);
+            break;
+
+        case X_PORT:
+            if ((code = reply_nb(fs)) == 0) return FTP_XFER_RUNNING;
+            if (code < 0) return xfer_end(x, FTP_XFER_ERROR);
+            if (code >= 400) {
+                ftp_fail(fs, "PORT: %s", fs->reply);
+                return xfer_end(x, FTP_XFER_ERROR);
+            }
+            if (xfer_command(x) < 0) return xfer_end(x, FTP_XFER_ERROR);
+            x->state = X_PRELIM;
+            break;
+
+        case X_PASV:
+            if ((code = reply_nb(fs)) == 0) return FTP_XFER_RUNNING;
+            if (code < 0) return xfer_end(x, FTP_XFER_ERROR);
+            if (code != 227) {
+                ftp_fail(fs, "PASV: %s", fs->reply);
+                return xfer_end(x, FTP_XFER_ERROR);
+            }
+            if (parse_pasv(fs, &sin) < 0) return xfer_end(x, FTP_XFER_ERROR);
+            inet_ntop(AF_INET, &sin.sin_addr, host, sizeof(host));
+            snprintf(port, sizeof(port), "%d", ntohs(sin.sin_port));
+            if ((x->data = dial(fs, host, port, 1)) < 0)
+                return xfer_end(x, FTP_XFER_ERROR);
+            x->state = X_CONNECT;
+            break;
+
+        case X_CONNECT: {
+            struct pollfd pfd = { x->data, POLLOUT, 0 };
+            if (poll(&pfd, 1, 0) == 0) return FTP_XFER_RUNNING;
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(x->data, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err) {
+                ftp_fail(fs, "conexión de datos: %s", strerror(err));
+                return xfer_end(x, FTP_XFER_ERROR);
+            }
+            if (xfer_command(x) < 0) return xfer_end(x, FTP_XFER_ERROR);
+            x->state = X_PRELIM;
+            break;
+        }
+
+        case X_PRELIM:
+            if ((code = reply_nb(fs)) == 0) return FTP_XFER_RUNNING;
+            if (code < 0) return xfer_end(x, FTP_XFER_ERROR);
+            if (code >= 400) {
+                /* el servidor no va a usar la conexión de datos */
+                ftp_fail(fs, "%s", fs->reply);
+                return xfer_end(x, FTP_XFER_ERROR);
+            }
+            if (code >= 200) x->final_seen = 1;
+            if (open_local(x) < 0) return xfer_fail(x);
+            if (x->listen >= 0) {
+                x->deadline = now_ms() + ACCEPT_SECS * 1000;
+                x->state = X_ACCEPT;
+            } else {
+                x->state = X_DATA;
+            }
+            break;
+
+        case X_ACCEPT: {
+            /* el servidor puede rendirse (425) en vez de conectar */
+            if (!x->final_seen) {
+                if ((code = reply_nb(fs)) < 0) return xfer_end(x, FTP_XFER_ERROR);
+                if (code >= 400) {
+                    ftp_fail(fs, "%s", fs->reply);
+                    return xfer_end(x, FTP_XFER_ERROR);
+                }
+                if (code >= 200) x->final_seen = 1;
+            }
+            int d = accept(x->listen, NULL, NULL);
+            if (d < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+                    errno != ECONNABORTED) {
+                    ftp_fail(fs, "accept: %s", strerror(errno));
+                    return xfer_fail(x);
+                }
+                if (now_ms() < x->deadline) return FTP_XFER_RUNNING;
+                ftp_fail(fs, "timeout esperando conexión de datos (el servidor no conectó)");
+                return xfer_fail(x);
+            }
+            if (!peer_ok(fs, d)) {
+                /* otro host se adelantó al servidor: descartar y seguir esperando */
+                close(d);
+                break;
+            }
+            close(x->listen);
+            x->listen = -1;
+            fcntl(d, F_SETFL, fcntl(d, F_GETFL) | O_NONBLOCK);
+            x->data = d;
+            x->state = X_DATA;
+            break;
+        }
+
+        case X_DATA: {
+            long long before = x->bytes;
+            r = x->kind == K_PUT ? data_send(x) : data_recv(x);
+            if (r < 0) return xfer_fail(x);
+            if (x->progress && x->bytes != before) x->progress(x, x->bytes, x->arg);
+            if (r == 0) return FTP_XFER_RUNNING;
+            /* fin de datos: cerrar para que el servidor vea el EOF (put) */
+            close(x->data);
+            x->data = -1;
+            if (x->final_seen) return xfer_end(x, FTP_XFER_DONE);
+            x->state = X_FINAL;
+            break;
+        }
+
+        case X_FINAL:
+            if ((code = reply_nb(fs)) == 0) return FTP_XFER_RUNNING;
+            if (code < 0) return xfer_end(x, FTP_XFER_ERROR);
+            if (code >= 400) {
+                ftp_fail(fs, "%s", fs->reply);
+                return xfer_end(x, FTP_XFER_ERROR);
+            }
+            return xfer_end(x, FTP_XFER_DONE);
+        }
+    }
+    return x->status;
+}
+
+int ftp_xfer_poll(ftp_xfer *x, int timeout_ms) {
+    short events;
+    int fd = ftp_xfer_fd(x, &events);
+    if (fd < 0) return x->status;
+    if (x->state == X_ACCEPT) {
+        /* listener y control a la vez, sin pasar del plazo del accept */
+        struct pollfd p[2] = { { fd, POLLIN, 0 }, { x->fs->ctrl, POLLIN, 0 } };
+        long long left = x->deadline - now_ms();
+        if (left < 0) left = 0;
+        if (timeout_ms < 0 || timeout_ms > left) timeout_ms = (int)left;
+        if (x->fs->rlen == 0 && poll(p, 2, timeout_ms) < 0 && errno != EINTR) {
+            ftp_fail(x->fs, "poll: %s", strerror(errno));
+            return xfer_fail(x);
+        }
+        return ftp_xfer_step(x);
+    }
+    struct pollfd pfd = { fd, events, 0 };
+    /* una respuesta ya en el buffer no hace saltar poll() */
+    if (fd != x->fs->ctrl || x->fs->rlen == 0) {
+        int r = poll(&pfd, 1, timeout_ms);
+        if (r < 0 && errno != EINTR) {
+            ftp_fail(x->fs, "poll: %s", strerror(errno));
+            return xfer_fail(x);
+        }
+        if (r <= 0) return FTP_XFER_RUNNING;
+    }
+    return ftp_xfer_step(x);
+}
+
+/*
+ * Hasta terminar, con el plazo de inactividad de la sesión (ftp_idle()): un
+ * servidor que deja de leer o de enviar sin cerrar la conexión (o una red
+ * que se queda en silencio) dejaría a poll() esperando para siempre. Cuenta
+ * como actividad cualquier byte movido o cambio de estado.
+ */
+int ftp_xfer_wait(ftp_xfer *x) {
+    ftp_session *fs = x->fs;
+    long long bytes = x->bytes, last = now_ms();
+    int state = x->state, st;
+    while ((st = ftp_xfer_poll(x, fs->idle > 0 ? 1000 : -1)) == FTP_XFER_RUNNING) {
+        if (x->bytes != bytes || x->state != state) {
+            bytes = x->bytes;
+            state = x->state;
+            last = now_ms();
+        } else if (fs->idle > 0 && now_ms() - last >= fs->idle * 1000LL) {
+            ftp_fail(fs, "transferencia sin actividad en %d s", fs->idle);
+            return xfer_fail(x);
+        }
+    }
+    return st;
+}
+
+void ftp_xfer_cancel(ftp_xfer *x) {
+    if (x->state == X_END) return;
+    xfer_abort(x);
+    ftp_fail(x->fs, "transferencia cancelada");
+    xfer_end(x, FTP_XFER_ERROR);
+}
+
+void ftp_xfer_free(ftp_xfer *x) {
+    if (!x) return;
+    if (x->state != X_END) ftp_xfer_cancel(x);
+    free(x->buf);
+    free(x);
+}
+
+/* ------------------ transferencias bloqueantes ------------------ */
+static int xfer_run(ftp_xfer *x) {
+    if (!x) return -1;
+    int st = ftp_xfer_wait(x);
+    ftp_xfer_free(x);
+    return st == FTP_XFER_DONE ? 0 : -1;
+}
+
+int ftp_list(ftp_session *fs, int outfd) {
+    return xfer_run(ftp_xfer_list(fs, outfd));
+}
+
+int ftp_get(ftp_session *fs, const char *remote, const char *local) {
+    return xfer_run(ftp_xfer_get(fs, remote, local));
+}
+
+int ftp_get_fd(ftp_session *fs, const char *remote, int outfd) {
+    return xfer_run(ftp_xfer_get_fd(fs, remote, outfd));
+}
+
+/* TYPE I antes de un REST, con el mismo plazo que la transferencia */
+static int put_binary(ftp_session *fs) {
+    int code = ftp_cmd_timeout(fs, fs->idle > 0 ? fs->idle * 1000 : -1, "TYPE I");
+    if (code < 0) return -1;
+    if (code >= 400) return ftp_fail(fs, "TYPE: %s", fs->reply);
+    fs->ascii = 0;
+    return 0;
+}
+
+/*
+ * put con reintentos: si se corta la conexión de datos, se queda sin
+ * actividad (ftp_idle()) o el servidor responde 4xx, se espera 1, 2, 4... s
+ * y se continúa desde el SIZE remoto, así un archivo de varios GB no vuelve
+ * a subirse desde el byte 0. Un 5xx es definitivo y sin control no hay
+ * sesión en la que reintentar.
+ */
+static int put_run(ftp_session *fs, const char *local, const char *remote,
+                   int resume, int port) {
+    int wait = 1;
+    for (int i = 0; ; i++) {
+        /* como en ftp_rest(): muchos servidores rechazan REST en ASCII */
+        if (resume && !fs->ascii && put_binary(fs) < 0) return -1;
+        /* pput: PORT sólo en esta transferencia; el pool de la sesión no se toca */
+        ftp_xfer *x = xfer_put(fs, local, remote, resume, port);
+        int started = x != NULL;
+        int rc = xfer_run(x);
+        if (rc == 0) return 0;
+        if (!started) return -1;                /* archivo local, sesión */
+        if (i >= fs->retries || fs->code >= 500 || !ftp_alive(fs)) return -1;
+        if (fs->log) {
+            fprintf(fs->log, "%s; reintento %d/%d en %d s\n", fs->errmsg, i + 1, fs->retries, wait);
+            fflush(fs->log);
+        }
+        sleep(wait);
+        wait = wait * 2 > RETRY_MAX ? RETRY_MAX : wait * 2;
+        resume = 1;
+    }
+}
+
+int ftp_put(ftp_session *fs, const char *local, const char *remote) {
+    return put_run(fs, local, remote, 0, 0);
+}
+
+int ftp_put_resume(ftp_session *fs, const char *local, const char *remote) {
+    return put_run(fs, local, remote, 1, 0);
+}
+
+/* ------------------ FXP (servidor a servidor) ------------------ */
+/*
+ * PASV en el destino, PORT con esa dirección en el origen: el origen se
+ * conecta directamente al destino y los datos nunca pasan por el cliente.
+ * La RETR va primero para que un archivo inexistente en el origen no deje
+ * al destino esperando una conexión que nunca llega; la conexión del
+ * origen queda en el backlog del listener PASV hasta que llega el STOR.
+ * Los errores quedan en src->errmsg.
+ */
+static int fxp_run(ftp_session *src, ftp_session *dst,
+                   const char *srcpath, const char *dstpath) {
+    struct sockaddr_in sin;
+    char arg[64];
+    int code;
+
+    /* ambos extremos en binario: un TYPE distinto corrompería los datos */
+    if (ftp_type(src, 0) < 0) return -1;
+    if (ftp_type(dst, 0) < 0) return ftp_fail(src, "destino: %s", dst->errmsg);
+
+    if ((code = ftp_cmd(dst, "PASV")) != 227 || parse_pasv(dst, &sin) < 0)
+        return ftp_fail(src, "destino PASV: %s", code < 0 ? dst->errmsg : dst->reply);
+    port_arg(arg, sizeof(arg), &sin);
+    if ((code = ftp_cmd(src, "PORT %s", arg)) < 0) return -1;
+    if (code >= 400) return ftp_fail(src, "origen PORT: %s", src->reply);
+
+    if ((code = ftp_cmd(src, "RETR %s", srcpath)) < 0) return -1;
+    if (code >= 400) return ftp_fail(src, "origen: %s", src->reply);
+
+    if ((code = ftp_cmd(dst, "STOR %s", dstpath)) < 0 || code >= 400) {
+        ftp_fail(src, "destino: %s", code < 0 ? dst->errmsg : dst->reply);
+        /* un PASV nuevo cierra el listener viejo: el origen aborta su envío */
+        ftp_cmd(dst, "PASV");
+        char keep[sizeof(src->errmsg)];
+        memcpy(keep, src->errmsg, sizeof(keep));
+        reply_timeout(src, ABOR_MS * 5);
+        memcpy(src->errmsg, keep, sizeof(keep));
+        return -1;
+    }
+
+    /*
+     * las dos respuestas finales (226). Los datos no pasan por aquí, así que
+     * no hay progreso que vigilar: la del origen llega cuando terminó de
+     * enviar (un servidor caído lo detecta el keepalive del control) y la del
+     * destino tiene que seguirla enseguida.
+     */
+    int csrc = ftp_reply(src);
+    if (csrc < 0) return -1;
+    int cdst = reply_timeout(dst, FXP_TAIL_MS);
+    if (cdst == 0) return ftp_fail(src, "destino: sin confirmación del STOR");
+    if (cdst < 0) return ftp_fail(src, "destino: %s", dst->errmsg);
+    if (csrc >= 400) return ftp_fail(src, "origen: %s", src->reply);
+    if (cdst >= 400) return ftp_fail(src, "destino: %s", dst->reply);
+    return 0;
+}
+
+int ftp_fxp(ftp_session *src, ftp_session *dst,
+            const char *srcpath, const char *dstpath) {
+    if (src->ctrl < 0 || dst->ctrl < 0) return ftp_fail(src, "sesión cerrada");
+    if (src->xfer || dst->xfer) return ftp_fail(src, "ya hay una transferencia en curso");
+
+    /* el TYPE I es sólo para la copia: cada sesión vuelve a su modo */
+    int sa = src->ascii, da = dst->ascii;
+    int rc = fxp_run(src, dst, srcpath, dstpath);
+    char keep[sizeof(src->errmsg)];
+    memcpy(keep, src->errmsg, sizeof(keep));
+    if (sa && src->ctrl >= 0 && ftp_type(src, 1) < 0 && rc == 0) {
+        memcpy(keep, src->errmsg, sizeof(keep));
+        rc = -1;
+    }
+    if (da && dst->ctrl >= 0 && ftp_type(dst, 1) < 0 && rc == 0) {
+        snprintf(keep, sizeof(keep), "destino: %.240s", dst->errmsg);
+        rc = -1;
+    }
+    memcpy(src->errmsg, keep, sizeof(keep));
+    return rc;
+}
+
+/* ------------------ pput (PORT - modo activo) ------------------ */
+/* put con PORT para esta transferencia, sea cual sea el modo de la sesión */
+int ftp_pput(ftp_session *fs, const char *localfile, const char *remote) {
+    return put_run(fs, localfile, remote, 0, 1);
+}
+
+int ftp_pput_resume(ftp_session *fs, const char *localfile, const char *remote) {
+    return put_run(fs, localfile, remote, 1, 1);
+}
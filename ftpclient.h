@@ -0,0 +1,148 @@
+/* ftpclient.h - interfaz de libftpclient (sesiones y transferencias FTP) */
+
+#ifndef FTPCLIENT_H
+#define FTPCLIENT_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#define FTP_LINELEN   512
+#define FTP_BUFSIZE   65536     /* buffer de datos por transferencia */
+#define FTP_LISTEN_POOL 2       /* listeners PORT preparados por sesión */
+#define FTP_RETRIES_DEFAULT 3   /* reintentos de put tras ftp_init() */
+#define FTP_IDLE_DEFAULT 60     /* s sin actividad: transferencia colgada */
+
+/*
+ * Sesión de control. Una sesión admite una sola transferencia a la vez
+ * (restricción del propio protocolo). Ninguna función de la biblioteca
+ * termina el proceso: los errores se devuelven como -1 / NULL y el motivo
+ * queda en 'errmsg'.
+ */
+typedef struct ftp_xfer ftp_xfer;
+
+typedef struct ftp_session {
+    int       ctrl;                     /* socket de control, -1 = cerrado  */
+    FILE     *log;                      /* eco de respuestas (NULL = nada)  */
+    long      restart_offset;           /* REST para la próxima RETR        */
+    int       code;                     /* último código de respuesta       */
+    char      reply[FTP_LINELEN];       /* última línea de respuesta        */
+    char      errmsg[256];              /* motivo del último fallo          */
+    ftp_xfer *xfer;                     /* transferencia en curso           */
+    /* buffer de lectura del control (respuestas sin bloquear) */
+    char      rbuf[FTP_LINELEN * 4];
+    size_t    rlen;
+    int       mline;                    /* código de respuesta multilínea   */
+    int       ascii;                    /* TYPE A: convertir CRLF <-> LF    */
+    int       wmode;                    /* FTP_WRITE_*: escritura de get    */
+    int       retries;                  /* put: reintentos tras un corte    */
+    int       idle;                     /* s sin actividad, 0 = sin límite  */
+    /* modo activo (PORT): dirección local y listeners ya enlazados */
+    int       active;                   /* PORT en vez de PASV              */
+    int       addr_known;
+    struct sockaddr_in local_addr;      /* IP local vista por el servidor   */
+    int       lpool[FTP_LISTEN_POOL];
+    unsigned short lport[FTP_LISTEN_POOL];
+    int       nlpool;
+} ftp_session;
+
+/* escritura de las descargas (diskwrite.c) */
+#define FTP_WRITE_CACHE    0            /* write() normal                   */
+#define FTP_WRITE_STREAM   1            /* fallocate + writeback y DONTNEED */
+#define FTP_WRITE_DIRECT   2            /* fallocate + O_DIRECT             */
+
+/* estado de una transferencia asíncrona */
+#define FTP_XFER_RUNNING   0
+#define FTP_XFER_DONE      1
+#define FTP_XFER_ERROR    -1
+
+typedef void (*ftp_progress_cb)(ftp_xfer *x, long long bytes, void *arg);
+typedef void (*ftp_done_cb)(ftp_xfer *x, int status, void *arg);
+
+/* ------------------ sesión ------------------ */
+void ftp_init(ftp_session *fs);
+int  ftp_open(ftp_session *fs, const char *host, const char *service);
+int  ftp_login(ftp_session *fs, const char *user, const char *pass);
+void ftp_close(ftp_session *fs);                /* QUIT + cierre */
+int  ftp_alive(ftp_session *fs);                /* control sin EOF ni 421 */
+
+/* comando simple: devuelve el código de respuesta o -1 */
+int  ftp_cmd(ftp_session *fs, const char *fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+int  ftp_cmd_timeout(ftp_session *fs, int ms, const char *fmt, ...)
+        __attribute__((format(printf, 3, 4)));
+int  ftp_reply(ftp_session *fs);                /* espera una respuesta */
+int  ftp_rest(ftp_session *fs, long offset);    /* TYPE I + REST validado */
+int  ftp_active(ftp_session *fs, int on);       /* PORT/PASV para todo */
+int  ftp_type(ftp_session *fs, int ascii);      /* TYPE A / TYPE I */
+int  ftp_writer(ftp_session *fs, const char *mode); /* "cache", "stream", "direct" */
+int  ftp_retries(ftp_session *fs, int n);       /* reintentos de put/pput */
+int  ftp_idle(ftp_session *fs, int secs);       /* plazo sin actividad */
+
+/* ------------------ transferencias bloqueantes ------------------ */
+/* fallan si pasan ftp_idle() s sin mover datos ni recibir respuestas (como ftp_xfer_wait()) */
+int  ftp_list(ftp_session *fs, int outfd);
+int  ftp_get(ftp_session *fs, const char *remote, const char *local);
+int  ftp_get_fd(ftp_session *fs, const char *remote, int outfd);
+int  ftp_put(ftp_session *fs, const char *local, const char *remote);
+int  ftp_pput(ftp_session *fs, const char *local, const char *remote);
+/* continúan desde el SIZE remoto (REST+STOR, o APPE si no hay REST) */
+int  ftp_put_resume(ftp_session *fs, const char *local, const char *remote);
+int  ftp_pput_resume(ftp_session *fs, const char *local, const char *remote);
+
+/* servidor a servidor: los datos van de src a dst sin pasar por aquí */
+int  ftp_fxp(ftp_session *src, ftp_session *dst,
+             const char *srcpath, const char *dstpath);
+
+/* ------------------ transferencias no bloqueantes ------------------ */
+/*
+ * ftp_xfer_*() envían el primer comando y vuelven enseguida. El llamador
+ * integra ftp_xfer_fd() en su propio poll() y llama ftp_xfer_step() cuando
+ * el descriptor está listo (o ftp_xfer_poll() si no tiene bucle propio).
+ * Las callbacks se invocan desde step(): progreso cada vez que se mueven
+ * datos, y fin exactamente una vez con FTP_XFER_DONE o FTP_XFER_ERROR.
+ * En modo activo, mientras el servidor no conecta, ftp_xfer_fd() devuelve
+ * el listener; el plazo de esa espera se comprueba en step(), así que un
+ * bucle propio debe llamarlo también cuando vence su timeout.
+ *
+ * "No bloqueante" se refiere a la red. step() y cancel() todavía pueden
+ * detenerse en estos puntos:
+ *  - al escribir el destino local: write() a disco, la espera del
+ *    writeback de la ventana anterior en FTP_WRITE_STREAM
+ *    (sync_file_range), y un pipe o stdout lleno en get_fd/splice, que
+ *    espera al lector (ftp_xfer_fd() sólo informa del socket; el
+ *    descriptor de get_fd debe ser bloqueante).
+ *  - al leer el archivo local en put.
+ *  - al abortar (error, plazo del accept, cancel): ABOR y sus respuestas,
+ *    hasta 2 s por respuesta.
+ */
+ftp_xfer *ftp_xfer_get(ftp_session *fs, const char *remote, const char *local);
+ftp_xfer *ftp_xfer_get_fd(ftp_session *fs, const char *remote, int outfd);
+ftp_xfer *ftp_xfer_put(ftp_session *fs, const char *local, const char *remote);
+ftp_xfer *ftp_xfer_put_resume(ftp_session *fs, const char *local, const char *remote);
+ftp_xfer *ftp_xfer_list(ftp_session *fs, int outfd);
+
+void ftp_xfer_callbacks(ftp_xfer *x, ftp_progress_cb progress,
+                        ftp_done_cb done, void *arg);
+int  ftp_xfer_fd(ftp_xfer *x, short *events);   /* fd y eventos a vigilar */
+int  ftp_xfer_step(ftp_xfer *x);                /* avanza sin bloquear */
+int  ftp_xfer_poll(ftp_xfer *x, int timeout_ms);/* poll() + step() */
+int  ftp_xfer_wait(ftp_xfer *x);                /* hasta terminar o ftp_idle() */
+void ftp_xfer_cancel(ftp_xfer *x);              /* ABOR */
+long long ftp_xfer_bytes(ftp_xfer *x);
+long long ftp_xfer_offset(ftp_xfer *x);        /* bytes ya en el destino */
+void ftp_xfer_free(ftp_xfer *x);
+
+/* ------------------ conversión ASCII (crlf.c) ------------------ */
+size_t ftp_crlf_to_lf(char *dst, const char *src, size_t n, int *pending_cr);
+size_t ftp_lf_to_crlf(char *dst, const char *src, size_t n, int *last_cr);
+
+/* ------------------ escritura de descargas (diskwrite.c) ------------------ */
+typedef struct ftp_dw ftp_dw;
+ftp_dw *ftp_dw_open(const char *path, int mode, long long offset, long long size);
+int     ftp_dw_write(ftp_dw *dw, const char *p, size_t n);
+long long ftp_dw_pending(ftp_dw *dw);
+int     ftp_dw_close(ftp_dw *dw);
+ssize_t ftp_splice(int from, int to, size_t n);
+
+#endif /* FTPCLIENT_H */
@@ -0,0 +1,359 @@
+/* ftpdaemon.c - daemon_main, daemon_worker, run_job, job_client */
+
+/*
+ * Modo daemon: mantiene MAX_PROCS sesiones de control ya autenticadas
+ * (una por proceso worker, con NOOP periódico) y recibe trabajos de
+ * procesos locales por un socket UNIX. Cada trabajo es una línea:
+ *
+ *   get <remoto> <local-absoluto>
+ *   put <local-absoluto> <remoto>
+ *   dir | pwd | noop | mkd <dir> | dele <archivo>
+ *
+ * El worker que lo atiende devuelve por el mismo socket las respuestas del
+ * servidor y termina con una línea "== OK" o "== FALLO".
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+#include <signal.h>
+#include <sys/wait.h>
+
+
+#include "ftpclient.h"
+
+
+extern int  errno;
+
+int  errexit(const char *format, ...);
+
+extern int MAX_PROCS;
+
+#define JOBLEN  1024
+#define KEEPALIVE_SECS 60   /* NOOP si la sesión lleva este tiempo ociosa */
+#define NOOP_MS     10000   /* espera máxima de la respuesta al NOOP      */
+#define JOB_SECS    10      /* plazo para recibir la línea del trabajo    */
+
+volatile sig_atomic_t daemon_stop = 0;
+
+void daemon_term(int signo) {
+    (void)signo;
+    daemon_stop = 1;
+}
+
+/* ruta del socket de trabajos: $FTP_SOCK o /tmp/TCPftp-<uid>.sock */
+void job_sockpath(char *buf, size_t n) {
+    char *env = getenv("FTP_SOCK");
+    if (env && *env) snprintf(buf, n, "%s", env);
+    else snprintf(buf, n, "/tmp/TCPftp-%d.sock", (int)getuid());
+}
+
+/* ------------------ socket de trabajos ------------------ */
+ssize_t job_readline(int fd, char *buf, size_t max) {
+    size_t idx = 0;
+    char c;
+    while (idx < max - 1) {
+        ssize_t n = read(fd, &c, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return n;
+        buf[idx++] = c;
+        if (c == '\n') break;
+    }
+    buf[idx] = '\0';
+    return (ssize_t)idx;
+}
+
+ssize_t job_write(int fd, const char *s) {
+    size_t total = 0, len = strlen(s);
+    while (total < len) {
+        ssize_t n = write(fd, s + total, len - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total += n;
+    }
+    return (ssize_t)total;
+}
+
+/* ------------------ sesión de control ------------------ */
+/* conecta y autentica; -1 si el servidor no responde o rechaza el login */
+int session_open(ftp_session *fs, const char *host, const char *service,
+                 const char *user, const char *pass) {
+    FILE *log = fs->log;
+    ftp_init(fs);
+    fs->log = log;
+    if (ftp_open(fs, host, service) < 0 || ftp_login(fs, user, pass) < 0) {
+        fprintf(stderr, "daemon: %s\n", fs->errmsg);
+        ftp_close(fs);
+        return -1;
+    }
+    /* FTP_ACTIVE=1: datos por PORT, con listeners ya preparados */
+    char *act = getenv("FTP_ACTIVE");
+    if (act && atoi(act) > 0) ftp_active(fs, 1);
+    char *wr = getenv("FTP_WRITER");
+    if (wr) ftp_writer(fs, wr);
+    /* FTP_RETRIES=n: un put cortado se reintenta desde lo ya subido */
+    char *rt = getenv("FTP_RETRIES");
+    if (rt) ftp_retries(fs, atoi(rt));
+    /* FTP_IDLE=s: una transferencia sin actividad en s segundos falla */
+    char *id = getenv("FTP_IDLE");
+    if (id) ftp_idle(fs, atoi(id));
+    return 0;
+}
+
+/* ------------------ ejecución de un trabajo ------------------ */
+/*
+ * Las respuestas del servidor (log de la sesión) y los listados se envían
+ * por el socket del trabajo, así el cliente ve lo mismo que en modo
+ * interactivo.
+ */
+int run_job(ftp_session *fs, int job) {
+    char line[JOBLEN];
+    int rc = -1;
+
+    if (job_readline(job, line, sizeof(line)) <= 0) return -1;
+    line[strcspn(line, "\r\n")] = 0;
+
+    int jfd = dup(job);
+    FILE *out = jfd >= 0 ? fdopen(jfd, "w") : NULL;
+    if (!out) { if (jfd >= 0) close(jfd); return -1; }
+    FILE *saved_log = fs->log;
+    fs->log = out;
+
+    char *tok = strtok(line, " ");
+    char *a1 = strtok(NULL, " ");
+    char *a2 = strtok(NULL, " ");
+
+    if (!tok) {
+        fprintf(out, "trabajo vacío\n");
+    } else if (strcmp(tok, "get") == 0 && a1 && a2) {
+        rc = ftp_get(fs, a1, a2);
+    } else if (strcmp(tok, "put") == 0 && a1 && a2) {
+        rc = ftp_put(fs, a1, a2);
+    } else if (strcmp(tok, "dir") == 0) {
+        fflush(out);
+        rc = ftp_list(fs, job);
+    } else if (strcmp(tok, "pwd") == 0 || strcmp(tok, "noop") == 0) {
+        int code = ftp_cmd(fs, "%s", strcmp(tok, "pwd") == 0 ? "PWD" : "NOOP");
+        rc = (code >= 200 && code < 300) ? 0 : -1;
+    } else if ((strcmp(tok, "mkd") == 0 || strcmp(tok, "dele") == 0) && a1) {
+        int code = ftp_cmd(fs, "%s %s", strcmp(tok, "mkd") == 0 ? "MKD" : "DELE", a1);
+        rc = (code >= 200 && code < 300) ? 0 : -1;
+    } else {
+        fprintf(out, "%s: trabajo no soportado\n", tok);
+    }
+
+    /* el motivo ya salió en el log si es la propia respuesta del servidor */
+    if (rc < 0 && tok && fs->errmsg[0] && strcmp(fs->errmsg, fs->reply) != 0)
+        fprintf(out, "%s\n", fs->errmsg);
+    fprintf(out, "== %s\n", rc == 0 ? "OK" : "FALLO");
+    fs->log = saved_log;
+    fclose(out);
+    return rc;
+}
+
+/* ------------------ worker: una sesión caliente ------------------ */
+void daemon_worker(int lsock, const char *host, const char *service,
+                   const char *user, const char *pass, int keepalive) {
+    ftp_session fs;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_DFL;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    fs.log = stdout;
+    if (session_open(&fs, host, service, user, pass) < 0) exit(1);
+
+    while (1) {
+        struct pollfd pfd = { lsock, POLLIN, 0 };
+        int r = poll(&pfd, 1, keepalive * 1000);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            exit(1);
+        }
+        if (r == 0) {
+            /* keepalive: si el servidor no responde, reabrir la sesión */
+            int code = fs.ctrl >= 0 ? ftp_cmd_timeout(&fs, NOOP_MS, "NOOP") : -1;
+            if (code < 200 || code >= 300) {
+                ftp_close(&fs);
+                session_open(&fs, host, service, user, pass);
+            }
+            continue;
+        }
+
+        /* socket no bloqueante: otro worker pudo llevarse el trabajo */
+        int job = accept(lsock, NULL, NULL);
+        if (job < 0) continue;
+        /* un cliente que conecta y no envía nada no retiene al worker */
+        struct timeval tv = { JOB_SECS, 0 };
+        setsockopt(job, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (!ftp_alive(&fs)) {
+            ftp_close(&fs);
+            session_open(&fs, host, service, user, pass);
+        }
+        if (fs.ctrl < 0) {
+            job_write(job, "sesión FTP no disponible\n== FALLO\n");
+        } else if (run_job(&fs, job) < 0 && !ftp_alive(&fs)) {
+            ftp_close(&fs);
+        }
+        close(job);
+    }
+}
+
+/* ------------------ daemon: supervisa a los workers ------------------ */
+int daemon_main(const char *host, const char *service,
+                const char *user, const char *pass) {
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    struct sockaddr_un sun;
+
+    job_sockpath(path, sizeof(path));
+    int l = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (l < 0) errexit("socket: %s\n", strerror(errno));
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", path);
+    unlink(path);
+    /* el daemon guarda credenciales: sólo el propio usuario puede usarlo */
+    mode_t old = umask(077);
+    if (bind(l, (struct sockaddr *)&sun, sizeof(sun)) < 0)
+        errexit("bind %s: %s\n", path, strerror(errno));
+    umask(old);
+    if (listen(l, 64) < 0) errexit("listen: %s\n", strerror(errno));
+    fcntl(l, F_SETFL, fcntl(l, F_GETFL) | O_NONBLOCK);
+
+    int keepalive = KEEPALIVE_SECS;
+    char *env = getenv("FTP_KEEPALIVE");
+    if (env && atoi(env) > 0) keepalive = atoi(env);
+
+    /* pasar a segundo plano salvo que se pida lo contrario */
+    if (!getenv("FTP_FOREGROUND")) {
+        pid_t pid = fork();
+        if (pid < 0) errexit("fork: %s\n", strerror(errno));
+        if (pid > 0) {
+            printf("daemon %d escuchando en %s\n", (int)pid, path);
+            exit(0);
+        }
+        setsid();
+        int null = open("/dev/null", O_RDWR);
+        char *log = getenv("FTP_DAEMON_LOG");
+        int logfd = log ? open(log, O_WRONLY | O_CREAT | O_APPEND, 0600) : -1;
+        dup2(null, 0);
+        dup2(logfd >= 0 ? logfd : null, 1);
+        dup2(logfd >= 0 ? logfd : null, 2);
+        if (null > 2) close(null);
+        if (logfd > 2) close(logfd);
+    }
+
+    /* el padre espera a sus workers con wait(): sin el handler de mget */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_DFL;
+    sigaction(SIGCHLD, &sa, NULL);
+    sa.sa_handler = daemon_term;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    pid_t *workers = calloc(MAX_PROCS, sizeof(pid_t));
+    if (!workers) errexit("daemon: sin memoria\n");
+    for (int i = 0; i < MAX_PROCS; i++) {
+        if ((workers[i] = fork()) == 0)
+            daemon_worker(l, host, service, user, pass, keepalive);
+    }
+
+    while (!daemon_stop) {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < MAX_PROCS; i++) {
+            if (workers[i] != pid) continue;
+            /* un worker que no pudo autenticar no debe girar en vacío */
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) sleep(1);
+            if (daemon_stop) { workers[i] = 0; break; }
+            if ((workers[i] = fork()) == 0)
+                daemon_worker(l, host, service, user, pass, keepalive);
+            break;
+        }
+    }
+
+    for (int i = 0; i < MAX_PROCS; i++)
+        if (workers[i] > 0) kill(workers[i], SIGTERM);
+    while (wait(NULL) > 0)
+        ;
+    free(workers);
+    close(l);
+    unlink(path);
+    return 0;
+}
+
+/* ------------------ cliente de trabajos (TCPftp -J ...) ------------------ */
+/* rutas locales relativas al directorio del proceso que envía el trabajo */
+void abs_path(const char *p, char *out, size_t n) {
+    char cwd[4096];
+    if (p[0] == '/' || !getcwd(cwd, sizeof(cwd))) snprintf(out, n, "%s", p);
+    else snprintf(out, n, "%s/%s", cwd, p);
+}
+
+int job_client(int argc, char *argv[]) {
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    char line[JOBLEN], local[4096];
+    struct sockaddr_un sun;
+    int n;
+
+    if (argc < 1) {
+        fprintf(stderr, "Uso: TCPftp -J get <remoto> [local] | put <local> [remoto] | dir | pwd | noop | mkd <dir> | dele <archivo>\n");
+        return 2;
+    }
+    if (strcmp(argv[0], "get") == 0 && argc >= 2) {
+        abs_path(argc >= 3 ? argv[2] : argv[1], local, sizeof(local));
+        n = snprintf(line, sizeof(line), "get %s %s\n", argv[1], local);
+    } else if (strcmp(argv[0], "put") == 0 && argc >= 2) {
+        abs_path(argv[1], local, sizeof(local));
+        n = snprintf(line, sizeof(line), "put %s %s\n", local, argc >= 3 ? argv[2] : argv[1]);
+    } else {
+        n = snprintf(line, sizeof(line), "%s %s\n", argv[0], argc >= 2 ? argv[1] : "");
+    }
+    if (n < 0 || (size_t)n >= sizeof(line)) {
+        fprintf(stderr, "trabajo demasiado largo\n");
+        return 2;
+    }
+
+    job_sockpath(path, sizeof(path));
+    int s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s < 0) { perror("socket"); return 2; }
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", path);
+    if (connect(s, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+        fprintf(stderr, "no hay daemon en %s: %s\n", path, strerror(errno));
+        return 2;
+    }
+    if (job_write(s, line) < 0) { perror("write"); return 2; }
+
+    int ok = 0;
+    char out[4096];
+    while (job_readline(s, out, sizeof(out)) > 0) {
+        if (strncmp(out, "== ", 3) == 0) { ok = strncmp(out + 3, "OK", 2) == 0; continue; }
+        fputs(out, stdout);
+    }
+    close(s);
+    return ok ? 0 : 1;
+}
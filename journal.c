@@ -0,0 +1,214 @@
+/* journal.c - journal_begin, journal_append, journal_end (diario de mget) */
+
+/*
+ * Diario de un lote de mget, para retomarlo si el cliente muere a medias.
+ * Es un archivo de texto de sólo-añadir con un registro por línea:
+ *
+ *      Q <nombre>              en cola
+ *      P <offset> <nombre>     en curso, <offset> bytes ya en disco
+ *      D <tamaño> <nombre>     completo, con el tamaño que quedó en disco
+ *
+ * El nombre es una clave que elige el llamador (mget usa host:puerto y la
+ * ruta remota), así lotes de servidores o directorios distintos no se pisan.
+ *
+ * Cada registro se escribe con un único write() sobre un descriptor con
+ * O_APPEND, así los hijos de mget pueden añadir a la vez sin bloqueos ni
+ * líneas mezcladas. Al leerlo vale el último registro de cada nombre; al
+ * empezar un lote el diario se reescribe compacto (una línea por archivo)
+ * con rename(), de modo que nunca queda a medio reescribir.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+
+struct jstate {
+    char      *name;
+    char       st;                      /* 'Q', 'P' o 'D'              */
+    long long  off;                     /* P: offset; D: tamaño        */
+    size_t     seq;                     /* orden en el archivo         */
+};
+
+int journal_begin(const char *path, char **files, int nfiles, long long *resume,
+                  long long *size);
+int journal_append(int fd, char st, long long off, const char *name);
+int journal_end(const char *path, char **files, int nfiles);
+
+static int jcmp(const void *a, const void *b) {
+    const struct jstate *x = a, *y = b;
+    int c = strcmp(x->name, y->name);
+    if (c) return c;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/* tabla ordenada por nombre con el último estado de cada archivo */
+static int journal_load(const char *path, struct jstate **tab, size_t *n) {
+    FILE *fp = fopen(path, "r");
+    char *line = NULL;
+    size_t cap = 0, len = 0, lcap = 0;
+    struct jstate *t = NULL;
+
+    *tab = NULL;
+    *n = 0;
+    if (!fp) return errno == ENOENT ? 0 : -1;
+    ssize_t r;
+    while ((r = getline(&line, &lcap, fp)) > 0) {
+        struct jstate e = { NULL, line[0], 0, len };
+        char *p = line + 2;
+        /* una línea sin '\n' quedó cortada por una caída a mitad de write() */
+        if (line[r - 1] != '\n' || r < 4 || line[1] != ' ') continue;
+        line[r - 1] = '\0';
+        if (e.st == 'P' || e.st == 'D') {
+            char *end;
+            e.off = strtoll(p, &end, 10);
+            if (end == p || *end != ' ') continue;
+            p = end + 1;
+        } else if (e.st != 'Q') {
+            continue;
+        }
+        if (len == cap) {
+            struct jstate *nt = realloc(t, (cap = cap ? 2 * cap : 64) * sizeof(*t));
+            if (!nt) break;
+            t = nt;
+        }
+        if (!(e.name = strdup(p))) break;
+        t[len++] = e;
+    }
+    free(line);
+    fclose(fp);
+
+    /* último registro de cada nombre */
+    qsort(t, len, sizeof(*t), jcmp);
+    size_t k = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (i + 1 < len && strcmp(t[i].name, t[i + 1].name) == 0) {
+            free(t[i].name);
+            continue;
+        }
+        t[k++] = t[i];
+    }
+    *tab = t;
+    *n = k;
+    return 0;
+}
+
+static struct jstate *journal_find(struct jstate *tab, size_t n, const char *name) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        int c = strcmp(tab[mid].name, name);
+        if (c == 0) return &tab[mid];
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+static int journal_compact(const char *path, struct jstate *tab, size_t n) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return -1;
+    for (size_t i = 0; i < n; i++) {
+        if (tab[i].st != 'Q') fprintf(fp, "%c %lld %s\n", tab[i].st, tab[i].off, tab[i].name);
+        else fprintf(fp, "%c %s\n", tab[i].st, tab[i].name);
+    }
+    if (fflush(fp) != 0 || fsync(fileno(fp)) < 0) {
+        fclose(fp);
+        unlink(tmp);
+        return -1;
+    }
+    if (fclose(fp) != 0 || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* un registro = un write() (O_APPEND lo hace atómico frente a otros hijos) */
+int journal_append(int fd, char st, long long off, const char *name) {
+    char rec[4200];
+    int len = st != 'Q' ? snprintf(rec, sizeof(rec), "%c %lld %s\n", st, off, name)
+                        : snprintf(rec, sizeof(rec), "Q %s\n", name);
+    if (fd < 0 || len < 0 || (size_t)len >= sizeof(rec)) return -1;
+    ssize_t w;
+    do {
+        w = write(fd, rec, len);
+    } while (w < 0 && errno == EINTR);
+    return w == len ? 0 : -1;
+}
+
+static void journal_free(struct jstate *tab, size_t n) {
+    for (size_t i = 0; i < n; i++) free(tab[i].name);
+    free(tab);
+}
+
+/*
+ * Prepara un lote: resume[i] = -1 si files[i] ya está completo (size[i] =
+ * tamaño registrado, para que el llamador compruebe el archivo), si no el
+ * offset desde el que seguir (0 = desde el principio). Los archivos nuevos
+ * entran en cola y el diario queda compacto.
+ */
+int journal_begin(const char *path, char **files, int nfiles, long long *resume,
+                  long long *size) {
+    struct jstate *tab;
+    size_t n;
+    if (journal_load(path, &tab, &n) < 0) return -1;
+
+    size_t extra = 0;
+    for (int i = 0; i < nfiles; i++) {
+        struct jstate *e = journal_find(tab, n, files[i]);
+        resume[i] = 0;
+        size[i] = -1;
+        if (!e) { extra++; continue; }
+        if (e->st == 'D') { resume[i] = -1; size[i] = e->off; }
+        else if (e->st == 'P') resume[i] = e->off;
+    }
+    if (extra) {
+        struct jstate *nt = realloc(tab, (n + extra) * sizeof(*tab));
+        if (!nt) { journal_free(tab, n); return -1; }
+        tab = nt;
+        size_t k = n;
+        for (int i = 0; i < nfiles; i++) {
+            if (journal_find(tab, n, files[i])) continue;
+            struct jstate e = { strdup(files[i]), 'Q', 0, k };
+            if (!e.name) { journal_free(tab, k); return -1; }
+            tab[k++] = e;
+        }
+        /* repetidos en la misma orden: quedan una vez */
+        qsort(tab, k, sizeof(*tab), jcmp);
+        n = 0;
+        for (size_t i = 0; i < k; i++) {
+            if (n > 0 && strcmp(tab[n - 1].name, tab[i].name) == 0) {
+                free(tab[i].name);
+                continue;
+            }
+            tab[n++] = tab[i];
+        }
+    }
+    int rc = journal_compact(path, tab, n);
+    journal_free(tab, n);
+    return rc;
+}
+
+/* fin de un lote: cuenta los pendientes y borra el diario si no queda ninguno */
+int journal_end(const char *path, char **files, int nfiles) {
+    struct jstate *tab;
+    size_t n;
+    int pending = 0, others = 0;
+    if (journal_load(path, &tab, &n) < 0) return -1;
+    for (int i = 0; i < nfiles; i++) {
+        struct jstate *e = journal_find(tab, n, files[i]);
+        if (!e || e->st != 'D') pending++;
+    }
+    for (size_t i = 0; i < n; i++) others += tab[i].st != 'D';
+    /* entradas pendientes de otros lotes conservan el diario */
+    if (pending == 0 && others == 0) unlink(path);
+    journal_free(tab, n);
+    return pending;
+}
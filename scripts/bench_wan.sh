@@ -0,0 +1,91 @@
+#!/usr/bin/env bash
+# Barrido de parámetros WAN con wanproxy delante del servidor FTP.
+# Uso:
+#   scripts/bench_wan.sh <host> <puerto> <usuario> <password> <archivo_remoto>
+#
+# Variables opcionales (listas separadas por espacios):
+#   DELAYS   retardo en un sentido en ms     (def. "0 40 80 100")
+#   BWS      ancho de banda en kbit/s, 0=sin límite (def. "0 100000 20000")
+#   JITTERS  jitter en ms                    (def. "0")
+#   LOSSES   pérdida emulada en %            (def. "0")
+#   REPS     repeticiones por combinación    (def. 1)
+#   PPORT    puerto local del proxy          (def. 2121)
+#   BENCH_CMDS  comandos del cliente tras el login, separados por ";"
+#               (def. "get <archivo_remoto>")
+#   FTP_PROCS   se pasa tal cual al cliente (para mget)
+#
+# Imprime CSV: delay_ms,jitter_ms,bw_kbit,loss_pct,rep,segundos,MB_s
+
+set -u
+
+if [ $# -lt 5 ]; then
+    sed -n '2,17p' "$0"
+    exit 1
+fi
+
+HOST=$1; PORT=$2; FUSER=$3; FPASS=$4; FILE=$5
+DELAYS=${DELAYS:-"0 40 80 100"}
+BWS=${BWS:-"0 100000 20000"}
+JITTERS=${JITTERS:-"0"}
+LOSSES=${LOSSES:-"0"}
+REPS=${REPS:-1}
+PPORT=${PPORT:-2121}
+BENCH_CMDS=${BENCH_CMDS:-"get $FILE"}
+
+# Ubicar binarios (el script vive en scripts/)
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+CLIENT=$ROOT/TCPftp
+PROXY=$ROOT/wanproxy
+if [ ! -x "$CLIENT" ] || [ ! -x "$PROXY" ]; then
+    echo "Compila primero con 'make' (faltan TCPftp y/o wanproxy)" >&2
+    exit 1
+fi
+
+# Directorio de trabajo temporal para no pisar archivos locales
+WORK=$(mktemp -d)
+PROXY_PID=
+cleanup() {
+    [ -n "$PROXY_PID" ] && kill "$PROXY_PID" 2>/dev/null
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+echo "delay_ms,jitter_ms,bw_kbit,loss_pct,rep,segundos,MB_s"
+for d in $DELAYS; do
+for bw in $BWS; do
+for j in $JITTERS; do
+for l in $LOSSES; do
+    BWARG=
+    [ "$bw" != "0" ] && BWARG="-b $bw"
+    # ventana del proxy por conexión: 2 x BDP (1 Gbit/s sin límite), mínimo
+    # 256 KB; más chica, la fila mediría la cola del proxy y no el enlace
+    Q=$(awk -v bw="$bw" -v d="$d" -v j="$j" 'BEGIN {
+            if (bw == 0) bw = 1000000
+            q = int(2 * bw / 8 * (d + j) / 1024) + 1
+            print (q < 256 ? 256 : q) }')
+    # shellcheck disable=SC2086
+    "$PROXY" -p "$PPORT" -d "$d" -j "$j" -l "$l" -q "$Q" $BWARG "$HOST" "$PORT" 2>/dev/null &
+    PROXY_PID=$!
+    sleep 0.3
+
+    for r in $(seq 1 "$REPS"); do
+        rm -rf "${WORK:?}"/*
+        t0=$(date +%s.%N)
+        (cd "$WORK" && printf '%s\n%s\n%s\nquit\n' "$FUSER" "$FPASS" \
+            "$(printf '%s' "$BENCH_CMDS" | tr ';' '\n')" \
+            | "$CLIENT" 127.0.0.1 "$PPORT" >/dev/null 2>&1)
+        t1=$(date +%s.%N)
+        bytes=$(find "$WORK" -type f -printf '%s\n' | awk '{s+=$1} END {print s+0}')
+        awk -v d="$d" -v j="$j" -v bw="$bw" -v l="$l" -v r="$r" \
+            -v t0="$t0" -v t1="$t1" -v b="$bytes" \
+            'BEGIN { s = t1 - t0; printf "%s,%s,%s,%s,%s,%.3f,%.2f\n",
+                     d, j, bw, l, r, s, (s > 0 ? b / 1048576 / s : 0) }'
+    done
+
+    kill "$PROXY_PID" 2>/dev/null
+    wait "$PROXY_PID" 2>/dev/null
+    PROXY_PID=
+done
+done
+done
+done
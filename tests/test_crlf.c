@@ -0,0 +1,183 @@
+/* test_crlf.c - prueba de crlf.c: rutas AVX2, SSE2 y escalar contra una referencia */
+
+/*
+ * Incluye crlf.c para llegar a las funciones estáticas de cada ruta. Los
+ * datos son aleatorios con muchos CR y LF, se cortan en bloques de tamaño
+ * aleatorio (el CR pendiente cruza de un bloque al siguiente) y se
+ * convierten tanto en buffers separados como en el mismo buffer, con la
+ * disposición que usan data_recv() y data_send().
+ *
+ *   make test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../crlf.c"
+
+#define MAXLEN 700
+#define ROUNDS 20000
+
+enum { P_SCALAR, P_SSE2, P_AVX2, NPATHS };
+static const char *pname[NPATHS] = { "escalar", "sse2", "avx2" };
+
+static int failures = 0;
+
+/* ------------------ referencias (flujo completo, byte a byte) ------------------ */
+static size_t ref_crlf_to_lf(char *dst, const char *src, size_t n) {
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++)
+        if (!(src[i] == '\r' && i + 1 < n && src[i + 1] == '\n')) dst[out++] = src[i];
+    return out;
+}
+
+static size_t ref_lf_to_crlf(char *dst, const char *src, size_t n) {
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (src[i] == '\n' && (i == 0 || src[i - 1] != '\r')) dst[out++] = '\r';
+        dst[out++] = src[i];
+    }
+    return out;
+}
+
+/* ------------------ una ruta concreta, con el mismo prólogo que la pública ------------------ */
+static int path_ok(int p) {
+#ifdef CRLF_X86
+    if (p == P_AVX2) return __builtin_cpu_supports("avx2");
+#endif
+#if defined(CRLF_X86) && defined(__SSE2__)
+    if (p == P_SSE2) return 1;
+#endif
+    return p == P_SCALAR;
+}
+
+static size_t crlf_path(int p, char *dst, const char *src, size_t n, int *pending_cr) {
+    size_t out = 0;
+    if (*pending_cr) {
+        *pending_cr = 0;
+        if (n == 0 || src[0] != '\n') dst[out++] = '\r';
+    }
+    if (n == 0) return out;
+#ifdef CRLF_X86
+    if (p == P_AVX2) return out + crlf_avx2(dst + out, src, n, pending_cr);
+#endif
+#if defined(CRLF_X86) && defined(__SSE2__)
+    if (p == P_SSE2) return out + crlf_sse2(dst + out, src, n, pending_cr);
+#endif
+    return crlf_tail(dst, out, src, 0, n, pending_cr);
+}
+
+static size_t lf_path(int p, char *dst, const char *src, size_t n, int *last_cr) {
+#ifdef CRLF_X86
+    if (p == P_AVX2) return lf_avx2(dst, src, n, last_cr);
+#endif
+#if defined(CRLF_X86) && defined(__SSE2__)
+    if (p == P_SSE2) return lf_sse2(dst, src, n, last_cr);
+#endif
+    return lf_tail(dst, 0, src, 0, n, last_cr);
+}
+
+/* ------------------ datos ------------------ */
+static void fill(char *buf, size_t n) {
+    static const char alpha[] = "\r\n\r\nab\r\n\n\rxyz";
+    int dense = rand() % 2;
+    for (size_t i = 0; i < n; i++)
+        buf[i] = dense ? alpha[rand() % (sizeof(alpha) - 1)] : (char)(rand() % 256);
+}
+
+static void check(const char *what, int p, const char *got, size_t glen,
+                  const char *want, size_t wlen, size_t n) {
+    if (glen == wlen && memcmp(got, want, wlen) == 0) return;
+    if (failures++ < 5)
+        fprintf(stderr, "FALLO %s (%s): n=%zu, salida %zu bytes, esperados %zu\n",
+                what, pname[p], n, glen, wlen);
+}
+
+/*
+ * Conversión por bloques. inplace: cada bloque se copia a buf+1 y se
+ * convierte a buf (data_recv); la salida se acumula aparte.
+ */
+static void test_crlf(int p, const char *src, size_t n, int inplace) {
+    static char want[MAXLEN], got[MAXLEN + 1], buf[MAXLEN + 2];
+    size_t wlen = ref_crlf_to_lf(want, src, n), glen = 0, i = 0;
+    int pending = 0;
+    while (i < n) {
+        size_t c = 1 + rand() % (n - i < 100 ? n - i : 100);
+        if (rand() % 4 == 0) c = n - i;
+        if (inplace) {
+            memcpy(buf + 1, src + i, c);
+            size_t k = crlf_path(p, buf, buf + 1, c, &pending);
+            memcpy(got + glen, buf, k);
+            glen += k;
+        } else {
+            glen += crlf_path(p, got + glen, src + i, c, &pending);
+        }
+        i += c;
+    }
+    /* n == 0 suelta el CR que quedó al final */
+    glen += crlf_path(p, got + glen, src, 0, &pending);
+    check(inplace ? "crlf->lf en el mismo buffer" : "crlf->lf", p, got, glen, want, wlen, n);
+    if (pending) check("crlf->lf: CR pendiente tras n=0", p, "", 1, "", 0, n);
+}
+
+/* inplace: cada bloque se lee en la mitad alta y se convierte a la baja (data_send) */
+static void test_lf(int p, const char *src, size_t n, int inplace) {
+    static char want[2 * MAXLEN], got[2 * MAXLEN], buf[2 * MAXLEN];
+    size_t wlen = ref_lf_to_crlf(want, src, n), glen = 0, i = 0;
+    int last = 0;
+    while (i < n) {
+        size_t c = 1 + rand() % (n - i < 100 ? n - i : 100);
+        if (rand() % 4 == 0) c = n - i;
+        if (inplace) {
+            memcpy(buf + c, src + i, c);
+            size_t k = lf_path(p, buf, buf + c, c, &last);
+            memcpy(got + glen, buf, k);
+            glen += k;
+        } else {
+            glen += lf_path(p, got + glen, src + i, c, &last);
+        }
+        i += c;
+    }
+    check(inplace ? "lf->crlf en el mismo buffer" : "lf->crlf", p, got, glen, want, wlen, n);
+}
+
+int main(void) {
+    static char src[MAXLEN];
+    int tested = 0;
+    srand(1234);
+
+    for (int p = 0; p < NPATHS; p++) {
+        if (!path_ok(p)) {
+            printf("crlf: ruta %s no disponible, se omite\n", pname[p]);
+            continue;
+        }
+        tested++;
+        for (int r = 0; r < ROUNDS; r++) {
+            size_t n = rand() % MAXLEN;
+            fill(src, n);
+            test_crlf(p, src, n, 0);
+            test_crlf(p, src, n, 1);
+            test_lf(p, src, n, 0);
+            test_lf(p, src, n, 1);
+        }
+    }
+
+    /* CR justo en el borde entre bloques, y el flush con n == 0 */
+    int pending = 0;
+    char out[4];
+    size_t k = ftp_crlf_to_lf(out, "a\r", 2, &pending);
+    k += ftp_crlf_to_lf(out + k, "\nb", 2, &pending);
+    if (k != 3 || memcmp(out, "a\nb", 3) != 0 || pending) check("borde CR|LF", 0, "", 1, "", 0, 4);
+    pending = 0;
+    k = ftp_crlf_to_lf(out, "x\r", 2, &pending);
+    k += ftp_crlf_to_lf(out + k, "", 0, &pending);
+    if (k != 2 || memcmp(out, "x\r", 2) != 0 || pending) check("flush n=0", 0, "", 1, "", 0, 2);
+
+    if (failures) {
+        printf("crlf: %d fallos\n", failures);
+        return 1;
+    }
+    printf("crlf: OK (%d rutas)\n", tested);
+    return 0;
+}
@@ -0,0 +1,110 @@
+/* test_journal.c - prueba de journal.c: carga, último registro, compactado y fin de lote */
+
+/*
+ * Incluye journal.c para revisar también journal_load(). Cada caso escribe
+ * un diario a mano (incluida una línea cortada por una caída), lo pasa por
+ * journal_begin()/journal_end() y comprueba lo que devuelven y lo que queda
+ * en el archivo.
+ *
+ *   make test
+ */
+
+#include <sys/stat.h>
+
+#include "../journal.c"
+
+static int failures = 0;
+static char jpath[64];
+
+#define CHECK(cond, ...) do {                                   \
+    if (!(cond)) {                                              \
+        failures++;                                             \
+        fprintf(stderr, "FALLO línea %d: ", __LINE__);          \
+        fprintf(stderr, __VA_ARGS__);                           \
+        fputc('\n', stderr);                                    \
+    }                                                           \
+} while (0)
+
+static void write_file(const char *text) {
+    FILE *fp = fopen(jpath, "w");
+    if (!fp) { perror(jpath); exit(2); }
+    fputs(text, fp);
+    fclose(fp);
+}
+
+static char *read_file(void) {
+    static char buf[4096];
+    FILE *fp = fopen(jpath, "r");
+    size_t n = fp ? fread(buf, 1, sizeof(buf) - 1, fp) : 0;
+    buf[n] = '\0';
+    if (fp) fclose(fp);
+    return buf;
+}
+
+static int exists(void) {
+    struct stat st;
+    return stat(jpath, &st) == 0;
+}
+
+int main(void) {
+    char *files[] = { "h:21/a", "h:21/b", "h:21/c", "h:21/d" };
+    long long resume[4], size[4];
+
+    snprintf(jpath, sizeof(jpath), "/tmp/test_journal.%d", (int)getpid());
+
+    /* sin diario: todo desde 0, y se crea compacto con los Q */
+    unlink(jpath);
+    CHECK(journal_begin(jpath, files, 2, resume, size) == 0, "begin sin diario");
+    CHECK(resume[0] == 0 && resume[1] == 0, "resume %lld %lld", resume[0], resume[1]);
+    CHECK(strcmp(read_file(), "Q h:21/a\nQ h:21/b\n") == 0, "compactado inicial: %s", read_file());
+
+    /*
+     * vale el último registro de cada clave; una línea sin '\n' (write()
+     * cortado) y las líneas mal formadas se ignoran
+     */
+    write_file("Q h:21/a\nQ h:21/b\nQ h:21/c\n"
+               "P 4096 h:21/a\nP 8192 h:21/a\n"
+               "D 1234 h:21/b\n"
+               "P x h:21/c\nZ 1 h:21/c\n"
+               "P 999 h:21/c");
+    CHECK(journal_begin(jpath, files, 4, resume, size) == 0, "begin");
+    CHECK(resume[0] == 8192, "a: resume %lld", resume[0]);
+    CHECK(resume[1] == -1 && size[1] == 1234, "b: resume %lld size %lld", resume[1], size[1]);
+    CHECK(resume[2] == 0, "c: resume %lld (línea cortada)", resume[2]);
+    CHECK(resume[3] == 0 && size[3] == -1, "d: nuevo, resume %lld", resume[3]);
+    CHECK(strcmp(read_file(), "P 8192 h:21/a\nD 1234 h:21/b\nQ h:21/c\nQ h:21/d\n") == 0,
+          "compactado: %s", read_file());
+
+    /* registros de un lote en marcha; un pendiente conserva el diario */
+    int fd = open(jpath, O_WRONLY | O_APPEND);
+    CHECK(journal_append(fd, 'D', 10, "h:21/a") == 0, "append D");
+    CHECK(journal_append(fd, 'D', 20, "h:21/c") == 0, "append D");
+    close(fd);
+    CHECK(journal_end(jpath, files, 4) == 1, "end: un pendiente (d)");
+    CHECK(exists(), "con pendientes el diario se conserva");
+
+    /* claves de otro lote (otro servidor) también lo conservan */
+    char *other[] = { "otro:21/a" };
+    fd = open(jpath, O_WRONLY | O_APPEND);
+    journal_append(fd, 'D', 30, "h:21/d");
+    journal_append(fd, 'Q', 0, "otro:21/a");
+    close(fd);
+    CHECK(journal_end(jpath, files, 4) == 0, "end: lote completo");
+    CHECK(exists(), "pendientes de otro lote conservan el diario");
+
+    /* la misma clave repetida en la orden queda una vez */
+    char *dup[] = { "otro:21/a", "otro:21/a" };
+    CHECK(journal_begin(jpath, dup, 2, resume, size) == 0, "begin repetidos");
+    fd = open(jpath, O_WRONLY | O_APPEND);
+    journal_append(fd, 'D', 5, "otro:21/a");
+    close(fd);
+    CHECK(journal_end(jpath, other, 1) == 0 && !exists(), "sin pendientes se borra");
+
+    unlink(jpath);
+    if (failures) {
+        printf("journal: %d fallos\n", failures);
+        return 1;
+    }
+    printf("journal: OK\n");
+    return 0;
+}
@@ -0,0 +1,427 @@
+/* wanproxy.c - main, relay, rewrite_pasv, rewrite_port */
+
+/*
+ * Proxy TCP local que emula un enlace WAN delante de un servidor FTP.
+ *
+ *   ./wanproxy [-p puerto] [-d ms] [-j ms] [-b kbit/s] [-l %] [-q KB] host puerto
+ *
+ * Cada conexión de control se reenvía al servidor real. Las respuestas
+ * "227 (h1,h2,h3,h4,p1,p2)" (PASV) y los comandos "PORT" se reescriben para
+ * que las conexiones de datos también pasen por el proxy, de modo que todo
+ * el tráfico sufre el mismo retardo, jitter, límite de ancho de banda y
+ * pérdida configurados. El ancho de banda es el del enlace: todas las
+ * conexiones del proxy (control y datos, cada una en su proceso) comparten
+ * un único reloj de "cable" por sentido en memoria compartida, así N
+ * transferencias en paralelo se reparten el límite en vez de tenerlo cada una.
+ *
+ * Cada conexión deja de leer cuando tiene -q KB sin entregar: es una
+ * ventana, y como tal limita esa conexión a cola / retardo. Por defecto se
+ * calcula del producto ancho de banda x retardo para que el techo lo ponga
+ * -b y no la cola.
+ *
+ * La pérdida no puede tirar bytes de un flujo TCP ya reensamblado; se emula
+ * como lo percibe la aplicación: el segmento afectado (y todo lo que viene
+ * detrás) llega con un retraso extra equivalente a un RTO de retransmisión.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <time.h>
+
+
+extern int  errno;
+
+int  errexit(const char *format, ...);
+int  connectTCP(const char *host, const char *service);
+int  passiveTCP(const char *service, int qlen);
+
+#define LINELEN     512
+#define CHUNK_MAX   16384       /* mayor trozo leído de una vez           */
+#define ACCEPT_MS   30000       /* espera máxima por la conexión de datos */
+#define RTO_MIN_US  200000      /* RTO mínimo de Linux (200 ms)            */
+#define QUEUE_MIN   (256 * 1024) /* cola mínima por sentido y conexión     */
+#define QUEUE_BPS   1e9         /* sin -b: la cola se dimensiona a 1 Gbit/s */
+
+/* ------------------ parámetros del enlace emulado ------------------ */
+long   delay_us  = 0;           /* retardo en un sentido                 */
+long   jitter_us = 0;           /* variación uniforme +/- jitter         */
+double bw_bps    = 0;           /* bits por segundo, 0 = sin límite      */
+double loss_pct  = 0;           /* probabilidad de "pérdida" por trozo   */
+size_t queue_max = 0;           /* bytes en vuelo por sentido, 0 = BDP   */
+int    verbose   = 0;
+
+/* cuándo queda libre el "cable" (bw), [0] subida y [1] bajada; compartido */
+long long *link_free;
+
+/* ------------------ reloj ------------------ */
+long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* SIGCHLD handler: recoge los procesos de relay terminados */
+void sigchld_handler(int signo) {
+    (void)signo;
+    int saved_errno = errno;
+    while (waitpid(-1, NULL, WNOHANG) > 0)
+        ;
+    errno = saved_errno;
+}
+
+ssize_t send_all(int fd, const void *buf, size_t len) {
+    size_t total = 0;
+    const char *p = buf;
+    while (total < len) {
+        ssize_t n = send(fd, p + total, len - total, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total += n;
+    }
+    return (ssize_t)total;
+}
+
+/* ------------------ cola de trozos con instante de entrega ------------------ */
+struct chunk {
+    struct chunk *next;
+    long long     release;      /* instante (us) en que puede entregarse */
+    size_t        len;
+    char          data[];
+};
+
+struct pipe_dir {
+    int           from, to;     /* sockets origen y destino               */
+    struct chunk *head, *tail;
+    size_t        queued;       /* bytes pendientes de entregar           */
+    int           link;         /* 0 = subida, 1 = bajada (link_free[])   */
+    long long     last_release; /* TCP entrega en orden                   */
+    int           eof;          /* origen cerró                           */
+    int           shut;         /* ya se propagó el cierre al destino     */
+    int           rewrite;      /* 1 = PASV (bajada), 2 = PORT (subida)   */
+    char          line[LINELEN];/* línea de control a medio recibir       */
+    size_t        linelen;
+};
+
+/* calcula el instante de entrega de 'len' bytes que llegan ahora */
+long long schedule(struct pipe_dir *d, size_t len) {
+    long long t = now_us();
+    if (bw_bps > 0) {
+        /* los demás procesos de relay reservan el mismo cable a la vez */
+        long long *lf = &link_free[d->link];
+        long long cost = (long long)((double)len * 8.0 * 1e6 / bw_bps);
+        long long old = __atomic_load_n(lf, __ATOMIC_RELAXED), nv;
+        do {
+            nv = (old < t ? t : old) + cost;
+        } while (!__atomic_compare_exchange_n(lf, &old, nv, 0,
+                                              __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+        t = nv;
+    }
+    t += delay_us;
+    if (jitter_us > 0)
+        t += (long long)((drand48() * 2.0 - 1.0) * (double)jitter_us);
+    if (loss_pct > 0 && drand48() * 100.0 < loss_pct) {
+        long long rto = 2 * delay_us + 4 * jitter_us;
+        t += rto > RTO_MIN_US ? rto : RTO_MIN_US;
+    }
+    if (t < d->last_release) t = d->last_release;
+    d->last_release = t;
+    return t;
+}
+
+void enqueue(struct pipe_dir *d, const char *buf, size_t len) {
+    struct chunk *c = malloc(sizeof(*c) + len);
+    if (!c) errexit("wanproxy: sin memoria\n");
+    c->next = NULL;
+    c->len = len;
+    memcpy(c->data, buf, len);
+    c->release = schedule(d, len);
+    if (d->tail) d->tail->next = c; else d->head = c;
+    d->tail = c;
+    d->queued += len;
+}
+
+/* ------------------ reescritura de direcciones ------------------ */
+
+/* socket de escucha en la IP local de 'near' (lado que recibirá la conexión) */
+int listen_near(int near, struct sockaddr_in *out) {
+    socklen_t alen = sizeof(*out);
+    if (getsockname(near, (struct sockaddr *)out, &alen) < 0) {
+        perror("getsockname");
+        return -1;
+    }
+    out->sin_port = htons(0);
+    int l = socket(AF_INET, SOCK_STREAM, 0);
+    if (l < 0) { perror("socket"); return -1; }
+    if (bind(l, (struct sockaddr *)out, sizeof(*out)) < 0 || listen(l, 1) < 0) {
+        perror("bind/listen");
+        close(l);
+        return -1;
+    }
+    alen = sizeof(*out);
+    getsockname(l, (struct sockaddr *)out, &alen);
+    return l;
+}
+
+void relay(int a, int b, int ctrl);
+
+/*
+ * Hijo de datos: acepta una conexión en 'l' y la empalma con host:port.
+ * El padre sólo necesita el número de puerto para reescribir la línea.
+ */
+int spawn_data(struct pipe_dir *d, int l, const char *host, int port) {
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork"); return -1; }
+    if (pid > 0) return 0;
+
+    /* el control sigue en el padre; no retener sus sockets aquí */
+    close(d->from);
+    close(d->to);
+
+    struct pollfd pfd = { l, POLLIN, 0 };
+    if (poll(&pfd, 1, ACCEPT_MS) <= 0) {
+        fprintf(stderr, "wanproxy: nadie conectó al canal de datos\n");
+        exit(1);
+    }
+    int a = accept(l, NULL, NULL);
+    close(l);
+    if (a < 0) { perror("accept"); exit(1); }
+    char sport[16];
+    snprintf(sport, sizeof(sport), "%d", port);
+    int b = connectTCP(host, sport);
+    if (verbose) fprintf(stderr, "wanproxy: datos -> %s:%d\n", host, port);
+    /* relay() espera (cliente, servidor); con PORT quien conectó es el servidor */
+    if (d->rewrite == 2) relay(b, a, 0);
+    else relay(a, b, 0);
+    exit(0);
+}
+
+/*
+ * Reescribe una línea de control. 'near' es el socket por el que llegará la
+ * conexión de datos (cliente para PASV, servidor para PORT).
+ */
+void rewrite_line(struct pipe_dir *d, int near, char *line, size_t *len) {
+    int h1, h2, h3, h4, p1, p2;
+    char *p;
+
+    if (d->rewrite == 1) {
+        if (strncmp(line, "227", 3) != 0 || !(p = strchr(line, '('))) return;
+    } else {
+        if (strncasecmp(line, "PORT ", 5) != 0) return;
+        p = line + 4;
+    }
+    if (sscanf(p + 1, "%d,%d,%d,%d,%d,%d", &h1, &h2, &h3, &h4, &p1, &p2) != 6)
+        return;
+
+    struct sockaddr_in me;
+    int l = listen_near(near, &me);
+    if (l < 0) return;
+    char host[64];
+    snprintf(host, sizeof(host), "%d.%d.%d.%d", h1, h2, h3, h4);
+    if (spawn_data(d, l, host, p1 * 256 + p2) < 0) { close(l); return; }
+    close(l);
+
+    unsigned char *ip = (unsigned char *)&me.sin_addr.s_addr;
+    unsigned short port = ntohs(me.sin_port);
+    if (d->rewrite == 1)
+        *len = snprintf(line, LINELEN, "227 Entering Passive Mode (%d,%d,%d,%d,%d,%d).\r\n",
+                        ip[0], ip[1], ip[2], ip[3], port / 256, port % 256);
+    else
+        *len = snprintf(line, LINELEN, "PORT %d,%d,%d,%d,%d,%d\r\n",
+                        ip[0], ip[1], ip[2], ip[3], port / 256, port % 256);
+}
+
+/* procesa bytes de control: sólo encola líneas completas (ya reescritas) */
+void feed_control(struct pipe_dir *d, int near, const char *buf, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        d->line[d->linelen++] = buf[i];
+        if (buf[i] == '\n' || d->linelen == LINELEN - 1) {
+            d->line[d->linelen] = '\0';
+            rewrite_line(d, near, d->line, &d->linelen);
+            enqueue(d, d->line, d->linelen);
+            d->linelen = 0;
+        }
+    }
+}
+
+/* ------------------ relay bidireccional con retardo ------------------ */
+void relay(int a, int b, int ctrl) {     /* a = lado cliente, b = lado servidor */
+    struct pipe_dir dir[2];
+    char buf[CHUNK_MAX];
+
+    memset(dir, 0, sizeof(dir));
+    dir[0].from = a; dir[0].to = b;     /* cliente -> servidor */
+    dir[1].from = b; dir[1].to = a;     /* servidor -> cliente */
+    dir[0].link = 0;
+    dir[1].link = 1;
+    if (ctrl) { dir[0].rewrite = 2; dir[1].rewrite = 1; }
+
+    /* trozos más pequeños con ancho de banda bajo: la cola avanza suave */
+    size_t chunk = CHUNK_MAX;
+    if (bw_bps > 0 && bw_bps / 8 / 100 < chunk)
+        chunk = bw_bps / 8 / 100 > 512 ? (size_t)(bw_bps / 8 / 100) : 512;
+
+    while (!(dir[0].shut && dir[1].shut)) {
+        struct pollfd pfd[2];
+        int nfd = 0, idx[2] = { -1, -1 };
+        long long now = now_us(), next = -1;
+
+        for (int i = 0; i < 2; i++) {
+            struct pipe_dir *d = &dir[i];
+            /* entregar lo que ya venció */
+            while (d->head && d->head->release <= now) {
+                struct chunk *c = d->head;
+                if (send_all(d->to, c->data, c->len) < 0) {
+                    if (verbose) perror("wanproxy: send");
+                    return;
+                }
+                d->head = c->next;
+                if (!d->head) d->tail = NULL;
+                d->queued -= c->len;
+                free(c);
+            }
+            if (d->eof && !d->head && !d->shut) {
+                shutdown(d->to, SHUT_WR);
+                d->shut = 1;
+            }
+            if (d->head && (next < 0 || d->head->release < next))
+                next = d->head->release;
+            if (!d->eof && d->queued < queue_max) {
+                pfd[nfd].fd = d->from;
+                pfd[nfd].events = POLLIN;
+                idx[nfd++] = i;
+            }
+        }
+        if (dir[0].shut && dir[1].shut) break;
+
+        int timeout = -1;
+        if (next >= 0) timeout = next > now ? (int)((next - now + 999) / 1000) : 0;
+        if (poll(pfd, nfd, timeout) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return;
+        }
+        for (int k = 0; k < nfd; k++) {
+            if (!(pfd[k].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            struct pipe_dir *d = &dir[idx[k]];
+            ssize_t n = recv(d->from, buf, chunk, 0);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                d->eof = 1;
+                if (d->linelen > 0) enqueue(d, d->line, d->linelen);
+                continue;
+            }
+            if (d->rewrite) feed_control(d, idx[k] == 0 ? b : a, buf, n);
+            else enqueue(d, buf, n);
+        }
+    }
+    close(a);
+    close(b);
+}
+
+/* 2 x BDP de un sentido (con jitter), nunca menos de QUEUE_MIN */
+size_t queue_auto(void) {
+    double bps = bw_bps > 0 ? bw_bps : QUEUE_BPS;
+    double q = 2.0 * bps / 8 * (double)(delay_us + jitter_us) / 1e6;
+    return q > QUEUE_MIN ? (size_t)q : QUEUE_MIN;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+        "Uso: %s [-p puerto] [-d ms] [-j ms] [-b kbit/s] [-l %%] [-q KB] [-s semilla] [-v] host puerto\n"
+        "  -p  puerto local de escucha (def. 2121)\n"
+        "  -d  retardo en cada sentido, RTT = 2*d (def. 0)\n"
+        "  -j  jitter uniforme +/- ms (def. 0)\n"
+        "  -b  ancho de banda por sentido, compartido por todas las conexiones, kbit/s (def. sin límite)\n"
+        "  -l  porcentaje de pérdida emulada como retraso de RTO (def. 0)\n"
+        "  -q  ventana por conexión y sentido en KB: bytes leídos y aún no entregados\n"
+        "      (def. 2 x ancho de banda x (d + j), mínimo 256; sin -b se toma 1 Gbit/s)\n",
+        prog);
+    exit(1);
+}
+
+/* ------------------ main ------------------ */
+int main(int argc, char *argv[]) {
+    char *lport = "2121";
+    long seed = (long)getpid();
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:d:j:b:l:q:s:v")) != -1) {
+        switch (opt) {
+        case 'p': lport = optarg; break;
+        case 'd': delay_us = (long)(atof(optarg) * 1000); break;
+        case 'j': jitter_us = (long)(atof(optarg) * 1000); break;
+        case 'b': bw_bps = atof(optarg) * 1000.0; break;
+        case 'l': loss_pct = atof(optarg); break;
+        case 'q': queue_max = (size_t)atol(optarg) * 1024; break;
+        case 's': seed = atol(optarg); break;
+        case 'v': verbose = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2) usage(argv[0]);
+    if (queue_max == 0) queue_max = queue_auto();
+    char *host = argv[optind];
+    char *service = argv[optind + 1];
+    srand48(seed);
+
+    /* antes de cualquier fork: todos los relays heredan el mismo mapeo */
+    link_free = mmap(NULL, 2 * sizeof(*link_free), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (link_free == MAP_FAILED) errexit("mmap: %s\n", strerror(errno));
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+    sa.sa_handler = SIG_IGN;
+    sa.sa_flags = 0;
+    sigaction(SIGPIPE, &sa, NULL);
+
+    int l = passiveTCP(lport, 16);
+    fprintf(stderr, "wanproxy: :%s -> %s:%s  delay=%ldms jitter=%ldms bw=%.0fkbit/s loss=%.2f%% queue=%zuKB\n",
+            lport, host, service, delay_us / 1000, jitter_us / 1000, bw_bps / 1000, loss_pct,
+            queue_max / 1024);
+
+    while (1) {
+        int c = accept(l, NULL, NULL);
+        if (c < 0) {
+            if (errno == EINTR) continue;
+            errexit("accept: %s\n", strerror(errno));
+        }
+        pid_t pid = fork();
+        if (pid < 0) { perror("fork"); close(c); continue; }
+        if (pid == 0) {
+            close(l);
+            srand48(seed ^ getpid());
+            int s = connectTCP(host, service);
+            if (verbose) fprintf(stderr, "wanproxy: control -> %s:%s\n", host, service);
+            relay(c, s, 1);
+            exit(0);
+        }
+        close(c);
+    }
+    return 0;
+}